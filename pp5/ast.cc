@@ -6,18 +6,29 @@
 #include "ast_decl.h"
 #include "ast_type.h"
 #include "errors.h"
+#include "stats.h"
 
 
-CodeGenerator *CG = new CodeGenerator();
+thread_local CodeGenerator *CG = NULL;
 
 Node::Node(yyltype loc) {
     location = new yyltype(loc);
     parent = NULL;
+    expr_type = NULL;
+    emit_loc = NULL;
+    Stats::Count(S_AstNodes);
 }
 
 Node::Node() {
     location = NULL;
     parent = NULL;
+    expr_type = NULL;
+    emit_loc = NULL;
+    Stats::Count(S_AstNodes);
+}
+
+Node::~Node() {
+    delete location;
 }
 
 
@@ -35,6 +46,16 @@ void Node::Print(int indentLevel, const char *label) {
 
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc) {
     name = strdup(n);
+    decl = NULL;
+}
+
+Identifier::Identifier(yyltype loc, const TokenText &n) : Node(loc) {
+    name = strndup(n.text, n.len);
+    decl = NULL;
+}
+
+Identifier::~Identifier() {
+    free(name);
 }
 
 void Identifier::PrintChildren(int indentLevel) {
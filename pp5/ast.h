@@ -6,12 +6,15 @@
 #include <iostream>
 #include <stdlib.h>   
 #include "location.h"
+#include "scanner.h"
 #include "scope.h"
 #include "errors.h"
 #include "codegen.h"
 
 
-extern CodeGenerator *CG;
+extern thread_local CodeGenerator *CG;
+
+class FnSummary;
 
 class Node
 {
@@ -25,9 +28,10 @@ class Node
     
     Node(yyltype loc);
     Node();
+    virtual ~Node();
     
     yyltype *GetLocation()   { return location; }
-    void SetParent(Node *p)  { parent = p; }
+    virtual void SetParent(Node *p)  { parent = p; }
     Node *GetParent()        { return parent; }
     
     virtual const char *GetPrintNameForNode() = 0;
@@ -44,6 +48,10 @@ class Node
     
     virtual void Emit() {}
     virtual Location * GetEmitLoc() { return emit_loc; }
+
+
+
+    virtual void Summarize(FnSummary *s) {}
 };
 
 class Identifier : public Node
@@ -55,6 +63,8 @@ class Identifier : public Node
   public:
     
     Identifier(yyltype loc, const char *name);
+    Identifier(yyltype loc, const TokenText &name);
+    ~Identifier();
     
     const char *GetPrintNameForNode()   { return "Identifier"; }
     void PrintChildren(int indentLevel);
@@ -1,10 +1,12 @@
 
 
 #include "ast_decl.h"
+#include <string>
 #include "ast_stmt.h"
 #include "ast_type.h"
 #include "list.h"
 #include "errors.h"
+#include "parallel.h"
 
 Decl::Decl(Identifier *n) : Node(*n->GetLocation()) {
     Assert(n != NULL);
@@ -13,12 +15,20 @@ Decl::Decl(Identifier *n) : Node(*n->GetLocation()) {
     expr_type = NULL;
 }
 
+Decl::~Decl() {
+    delete id;
+}
+
 VarDecl::VarDecl(Identifier *n, Type *t) : Decl(n) {
     Assert(n != NULL && t != NULL);
     (type=t)->SetParent(this);
     class_member_ofst = -1;
 }
 
+VarDecl::~VarDecl() {
+    delete emit_loc;
+}
+
 void VarDecl::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -62,6 +72,7 @@ void VarDecl::AssignOffset() {
     if (this->IsGlobal()) {
         emit_loc = new Location(gpRelative, CG->GetNextGlobalLoc(),
                 id->GetIdName());
+        if (type->IsReferenceType()) emit_loc->SetRefKind(HeapRef);
     }
 }
 
@@ -82,9 +93,17 @@ void VarDecl::Emit() {
         
         emit_loc = new Location(fpRelative, CG->GetNextLocalLoc(),
                 id->GetIdName());
+        if (type->IsReferenceType()) emit_loc->SetRefKind(HeapRef);
     }
 }
 
+void VarDecl::PrintLayout(std::ostream &out) {
+    out << "var " << id << ' ' << type;
+    if (emit_loc)
+        out << ' ' << emit_loc->GetSegment() << ' ' << emit_loc->GetOffset();
+    out << ';';
+}
+
 ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType*> *imp,
         List<Decl*> *m) : Decl(n) {
     
@@ -95,6 +114,9 @@ ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType*> *imp,
     (members=m)->SetParentAll(this);
     instance_size = 4;
     vtable_size = 0;
+    instantiated = true;
+    var_members = NULL;
+    methods = NULL;
 }
 
 void ClassDecl::PrintChildren(int indentLevel) {
@@ -359,11 +381,41 @@ void ClassDecl::AddPrefixToMethods() {
     }
 }
 
+void ClassDecl::PrintLayout(std::ostream &out) {
+    out << "class " << id;
+    if (extends) out << " extends " << extends;
+    for (int i = 0; i < implements->NumElements(); i++)
+        out << " implements " << implements->Nth(i);
+    out << " size " << instance_size << " vtable";
+    for (int i = 0; methods && i < methods->NumElements(); i++)
+        out << ' ' << methods->Nth(i)->GetId();
+    out << " {";
+    for (int i = 0; i < members->NumElements(); i++)
+        members->Nth(i)->PrintLayout(out);
+    out << '}';
+}
+
 void ClassDecl::Emit() {
-  int j = 0;
-  for(int i = 0; i < 300; i++){
-    j++;
-  }
+    for (int i = 0; i < members->NumElements(); i++) {
+        Decl *d = members->Nth(i);
+        if (d->IsFnDecl()) d->Emit();
+    }
+    this->EmitVTable();
+}
+
+void ClassDecl::EmitVTable() {
+    List<const char*> *labels = new List<const char*>;
+    for (int i = 0; i < methods->NumElements(); i++) {
+        FnDecl *fn = methods->Nth(i);
+        labels->Append(fn->IsReachable() ? fn->GetId()->GetIdName() : "0");
+    }
+    List<int> *refs = new List<int>;
+    for (int i = 0; i < var_members->NumElements(); i++) {
+        VarDecl *v = var_members->Nth(i);
+        if (v->GetType()->IsReferenceType())
+            refs->Append(v->GetEmitLoc()->GetOffset());
+    }
+    CG->GenVTable(id->GetIdName(), labels, refs);
 }
 
 InterfaceDecl::InterfaceDecl(Identifier *n, List<Decl*> *m) : Decl(n) {
@@ -405,6 +457,13 @@ void InterfaceDecl::Check(checkT c) {
     
     
     
+}
+
+void InterfaceDecl::PrintLayout(std::ostream &out) {
+    out << "interface " << id << " {";
+    for (int i = 0; i < members->NumElements(); i++)
+        members->Nth(i)->PrintLayout(out);
+    out << '}';
 }
 
 void InterfaceDecl::Emit() {
@@ -419,6 +478,13 @@ FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
     (formals=d)->SetParentAll(this);
     body = NULL;
     vtable_ofst = -1;
+    effects = EF_All;
+    memo_keys = -1;
+    reachable = true;
+    memo_slot = NULL;
+    memo_args = NULL;
+    scope_begin = scope_end = -1;
+    source_span = NULL;
 }
 
 void FnDecl::SetFunctionBody(Stmt *b) {
@@ -445,10 +511,12 @@ void FnDecl::BuildST() {
         idx = ScopeM->InsertSymbol(this);
         id->SetDecl(this);
     }
+    scope_begin = ScopeM->GetScopeCount();
     ScopeM->BuildScope();
     formals->CheckAll(E_BuildST);
     if (body) body->Check(E_BuildST); 
     ScopeM->ExitScope();
+    scope_end = ScopeM->GetScopeCount();
 }
 
 void FnDecl::CheckDecl() {
@@ -479,6 +547,13 @@ void FnDecl::Check(checkT c) {
             this->BuildST(); break;
         case E_CheckDecl:
             this->CheckDecl(); break;
+        case E_CheckType:
+            
+            
+            if (ParallelCheck::Defer(this)) {
+                ScopeM->SetScopeCount(scope_end);
+                break;
+            }
         default:
             returnType->Check(c);
             id->Check(c);
@@ -515,6 +590,12 @@ bool FnDecl::IsEquivalentTo(Decl *other) {
     return true;
 }
 
+void FnDecl::ReleaseBody() {
+    ScopeM->ReleaseScopes(scope_begin + 1, scope_end);
+    delete body;
+    body = NULL;
+}
+
 void FnDecl::AddPrefixToMethods() {
     
     
@@ -528,6 +609,18 @@ void FnDecl::AddPrefixToMethods() {
     }
 }
 
+void FnDecl::PrintLayout(std::ostream &out) {
+    out << "fn " << id << '(';
+    for (int i = 0; i < formals->NumElements(); i++)
+        out << (i ? "," : "") << formals->Nth(i)->GetType();
+    out << ") " << returnType << " vt " << vtable_ofst << " fx " << effects
+        << " memo " << memo_keys << ';';
+}
+
+void FnDecl::Summarize(FnSummary *s) {
+    if (body) body->Summarize(s);
+}
+
 void FnDecl::AssignMemberOffset(bool inClass, int offset) {
     vtable_ofst = offset;
 }
@@ -561,14 +654,99 @@ void FnDecl::Emit() {
         }
         Location *l = new Location(fpRelative, CG->GetNextParamLoc(),
                 v->GetId()->GetIdName());
+        if (v->GetType()->IsReferenceType()) l->SetRefKind(HeapRef);
         v->SetEmitLoc(l);
     }
 
+    if (memo_keys >= 0) this->EmitMemoLookup();
     if (body) body->Emit();
 
     
     f->SetFrameSize(CG->GetFrameSize());
+    f->SetParamSize(CG->GetParamSize());
 
     CG->GenEndFunc();
+    if (memo_keys >= 0) CG->GenMemoTable(id->GetIdName(), MemoEntryBytes());
+    delete memo_args;
+    memo_args = NULL;
+    memo_slot = NULL;
+}
+
+
+
+
+
+void FnDecl::EmitMemoLookup() {
+    const int size = CodeGenerator::MemoSlots;
+    const int first = CodeGenerator::MemoHeaderSize;
+    const int word = CodeGenerator::VarSize;
+    std::string label = std::string(id->GetIdName()) + ".memo";
+    Location *table = CG->GenLoadLabel(label.c_str());
+    Location *zero = CG->GenLoadConstant(0);
+    Location *slots = CG->GenLoadConstant(size);
+    const char *miss = CG->NewLabel();
+    memo_slot = CG->GenTempVar();
+    CG->GenAssign(memo_slot, zero);
+
+    Location *index;
+    if (memo_keys == 0) {
+        index = formals->Nth(0)->GetEmitLoc();
+        Location *low = CG->GenBinaryOp(">=", index, zero);
+        Location *high = CG->GenBinaryOp("<", index, slots);
+        CG->GenIfZ(CG->GenBinaryOp("&&", low, high), miss);
+    } else {
+        
+        
+        Location *hash = NULL;
+        Location *mult = CG->GenLoadConstant(31);
+        memo_args = new List<Location*>;
+        for (int i = 0; i < memo_keys; i++) {
+            Location *arg = CG->GenTempVar();
+            CG->GenAssign(arg, formals->Nth(i)->GetEmitLoc());
+            memo_args->Append(arg);
+            Location *part = CG->GenBinaryOp("%", arg, slots);
+            if (hash)
+                part = CG->GenBinaryOp("%", CG->GenBinaryOp("+",
+                           CG->GenBinaryOp("*", hash, mult), part), slots);
+            hash = part;
+        }
+        index = CG->GenBinaryOp("%", CG->GenBinaryOp("+", hash, slots),
+                                slots);
+    }
+
+    Location *bytes = CG->GenLoadConstant(MemoEntryBytes());
+    Location *entry = CG->GenBinaryOp("+", table,
+                                      CG->GenBinaryOp("*", index, bytes));
+    CG->GenAssign(memo_slot, entry);
+    CG->GenIfZ(CG->GenLoad(entry, first), miss);
+    for (int i = 0; i < memo_keys; i++) {
+        Location *key = CG->GenLoad(entry, first + (2 + i) * word);
+        CG->GenIfZ(CG->GenBinaryOp("==", key, memo_args->Nth(i)), miss);
+    }
+    this->EmitMemoCount(table, 0);
+    CG->GenReturn(CG->GenLoad(entry, first + word));
+    CG->GenLabel(miss);
+    this->EmitMemoCount(table, word);
+}
+
+void FnDecl::EmitMemoCount(Location *table, int offset) {
+    Location *count = CG->GenLoad(table, offset);
+    CG->GenStore(table, CG->GenBinaryOp("+", count, CG->GenLoadConstant(1)),
+                 offset);
+}
+
+
+
+
+void FnDecl::EmitMemoStore(Location *val) {
+    const int first = CodeGenerator::MemoHeaderSize;
+    const int word = CodeGenerator::VarSize;
+    const char *skip = CG->NewLabel();
+    CG->GenIfZ(memo_slot, skip);
+    CG->GenStore(memo_slot, val, first + word);
+    for (int i = 0; i < memo_keys; i++)
+        CG->GenStore(memo_slot, memo_args->Nth(i), first + (2 + i) * word);
+    CG->GenStore(memo_slot, CG->GenLoadConstant(1), first);
+    CG->GenLabel(skip);
 }
 
@@ -21,6 +21,7 @@ class Decl : public Node
   public:
     
     Decl(Identifier *name);
+    ~Decl();
     
     friend std::ostream& operator<<(std::ostream& out, Decl *d)
         { return out << d->id; }
@@ -35,6 +36,10 @@ class Decl : public Node
     virtual void AssignOffset() {}
     virtual void AssignMemberOffset(bool inClass, int offset) {}
     virtual void AddPrefixToMethods() {}
+
+
+
+    virtual void PrintLayout(std::ostream &out) {}
 };
 
 class VarDecl : public Decl
@@ -47,6 +52,7 @@ class VarDecl : public Decl
   public:
     
     VarDecl(Identifier *name, Type *type);
+    ~VarDecl();
     
     const char *GetPrintNameForNode() { return "VarDecl"; }
     void PrintChildren(int indentLevel);
@@ -58,15 +64,16 @@ class VarDecl : public Decl
     void AssignMemberOffset(bool inClass, int offset);
     void Emit();
     void SetEmitLoc(Location *l) { emit_loc = l; }
-
-  protected:
-    void BuildST();
-    void CheckDecl();
+    void PrintLayout(std::ostream &out);
     bool IsGlobal() { return this->GetParent()->GetParent() == NULL; }
     bool IsClassMember() {
         Decl *d = dynamic_cast<Decl*>(this->GetParent());
         return d ? d->IsClassDecl() : false;
     }
+
+  protected:
+    void BuildST();
+    void CheckDecl();
 };
 
 class FnDecl;
@@ -79,6 +86,7 @@ class ClassDecl : public Decl
     List<NamedType*> *implements;
     int instance_size;
     int vtable_size;
+    bool instantiated;
     List<VarDecl*> *var_members;
     List<FnDecl*> *methods;
 
@@ -97,10 +105,15 @@ class ClassDecl : public Decl
     
     void AssignOffset();
     void Emit();
+    void EmitVTable();
     int GetInstanceSize() { return instance_size; }
     int GetVTableSize() { return vtable_size; }
+    List<FnDecl*> *GetMethods() { return methods; }
+    bool IsInstantiated() { return instantiated; }
+    void SetInstantiated(bool b) { instantiated = b; }
     void AddMembersToList(List<VarDecl*> *vars, List<FnDecl*> *fns);
     void AddPrefixToMethods();
+    void PrintLayout(std::ostream &out);
 
   protected:
     void BuildST();
@@ -125,6 +138,7 @@ class InterfaceDecl : public Decl
     List<Decl*> * GetMembers() { return members; }
     
     void Emit();
+    void PrintLayout(std::ostream &out);
 
   protected:
     void BuildST();
@@ -138,11 +152,23 @@ class FnDecl : public Decl
     Type *returnType;
     Stmt *body;
     int vtable_ofst;
+    int effects;
+    int memo_keys;
+    bool reachable;
+    Location *memo_slot;
+    List<Location*> *memo_args;
+    int scope_begin, scope_end;
+    yyltype *source_span;
 
   public:
     
     FnDecl(Identifier *name, Type *returnType, List<VarDecl*> *formals);
     void SetFunctionBody(Stmt *b);
+
+
+
+    void SetSourceSpan(yyltype span) { source_span = new yyltype(span); }
+    yyltype *GetSourceSpan() { return source_span; }
     
     const char *GetPrintNameForNode() { return "FnDecl"; }
     void PrintChildren(int indentLevel);
@@ -155,7 +181,22 @@ class FnDecl : public Decl
     void AddPrefixToMethods();
     void AssignMemberOffset(bool inClass, int offset);
     void Emit();
+    void ReleaseBody();
     int GetVTableOffset() { return vtable_ofst; }
+    void Summarize(FnSummary *s);
+    int GetEffects() { return effects; }
+    void SetEffects(int e) { effects = e; }
+
+    
+    
+    
+    
+    int GetMemoKeys() { return memo_keys; }
+    void SetMemoKeys(int k) { memo_keys = k; }
+    bool IsReachable() { return reachable; }
+    void SetReachable(bool b) { reachable = b; }
+    void EmitMemoStore(Location *val);
+    void PrintLayout(std::ostream &out);
     bool HasReturnValue() { return returnType != Type::voidType; }
     bool IsClassMember() {
         Decl *d = dynamic_cast<Decl*>(this->GetParent());
@@ -165,6 +206,9 @@ class FnDecl : public Decl
   protected:
     void BuildST();
     void CheckDecl();
+    int MemoEntryBytes() { return (2 + memo_keys) * CodeGenerator::VarSize; }
+    void EmitMemoLookup();
+    void EmitMemoCount(Location *table, int offset);
 };
 
 #endif
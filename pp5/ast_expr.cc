@@ -5,6 +5,7 @@
 #include "ast_decl.h"
 #include "ast_expr.h"
 #include "ast_type.h"
+#include "callgraph.h"
 #include "errors.h"
 
 void EmptyExpr::PrintChildren(int indentLevel) {
@@ -80,13 +81,15 @@ void BoolConstant::Emit() {
     emit_loc = CG->GenLoadConstant(value ? 1 : 0);
 }
 
-StringConstant::StringConstant(yyltype loc, const char *val) : Expr(loc) {
-    Assert(val != NULL);
-    value = strdup(val);
+StringConstant::StringConstant(yyltype loc, const TokenText &val)
+  : Expr(loc) {
+    Assert(val.text != NULL);
+    value = val.text;
+    len = val.len;
 }
 
 void StringConstant::PrintChildren(int indentLevel) {
-    printf("%s",value);
+    printf("%.*s", len, value);
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
 }
@@ -98,7 +101,7 @@ void StringConstant::Check(checkT c) {
 }
 
 void StringConstant::Emit() {
-    emit_loc = CG->GenLoadConstant(value);
+    emit_loc = CG->GenLoadConstant(value, len);
 }
 
 void NullConstant::PrintChildren(int indentLevel) {
@@ -141,6 +144,12 @@ CompoundExpr::CompoundExpr(Operator *o, Expr *r)
     (right=r)->SetParent(this);
 }
 
+CompoundExpr::~CompoundExpr() {
+    delete op;
+    delete left;
+    delete right;
+}
+
 void CompoundExpr::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -149,6 +158,11 @@ void CompoundExpr::PrintChildren(int indentLevel) {
     right->Print(indentLevel+1);
 }
 
+void CompoundExpr::Summarize(FnSummary *s) {
+    if (left) left->Summarize(s);
+    right->Summarize(s);
+}
+
 void ArithmeticExpr::CheckType() {
     if (left) left->Check(E_CheckType);
     op->Check(E_CheckType);
@@ -204,6 +218,12 @@ void ArithmeticExpr::Emit() {
     emit_loc = CG->GenBinaryOp(op->GetOpStr(), l, right->GetEmitLocDeref());
 }
 
+void ArithmeticExpr::Summarize(FnSummary *s) {
+    CompoundExpr::Summarize(s);
+    if (!strcmp(op->GetOpStr(), "/") || !strcmp(op->GetOpStr(), "%"))
+        s->Add(EF_Halts);
+}
+
 void RelationalExpr::CheckType() {
     left->Check(E_CheckType);
     op->Check(E_CheckType);
@@ -301,6 +321,13 @@ void EqualityExpr::Emit() {
     }
 }
 
+void EqualityExpr::Summarize(FnSummary *s) {
+    CompoundExpr::Summarize(s);
+    if (left->GetType() == Type::stringType
+        && right->GetType() == Type::stringType)
+        s->Add(CodeGenerator::BuiltInEffects(StringEqual));
+}
+
 void LogicalExpr::CheckType() {
     if (left) left->Check(E_CheckType);
     op->Check(E_CheckType);
@@ -401,6 +428,13 @@ void AssignExpr::Emit() {
     }
 }
 
+void AssignExpr::Summarize(FnSummary *s) {
+    right->Summarize(s);
+    LValue *l = dynamic_cast<LValue*>(left);
+    if (l) l->SummarizeStore(s);
+    else left->Summarize(s);
+}
+
 void This::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
 }
@@ -411,8 +445,7 @@ void This::CheckType() {
         ReportError::ThisOutsideClassScope(this);
     } else {
         
-        expr_type = new NamedType(d->GetId());
-        expr_type->SetSelfType();
+        expr_type = d->GetType();
     }
 }
 
@@ -431,6 +464,11 @@ ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
     (subscript=s)->SetParent(this);
 }
 
+ArrayAccess::~ArrayAccess() {
+    delete base;
+    delete subscript;
+}
+
 void ArrayAccess::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -497,11 +535,25 @@ void ArrayAccess::Emit() {
     Location *t9 = CG->GenLoadConstant(expr_type->GetTypeSize());
     Location *t10 = CG->GenBinaryOp("*", t9, t0);
     Location *t11 = CG->GenBinaryOp("+", t3, t10);
+    t11->SetRefKind(DerivedRef);
     emit_loc = t11;
 }
 
+void ArrayAccess::Summarize(FnSummary *s) {
+    base->Summarize(s);
+    subscript->Summarize(s);
+    s->Add(EF_ReadsMemory | EF_Halts);
+}
+
+void ArrayAccess::SummarizeStore(FnSummary *s) {
+    base->Summarize(s);
+    subscript->Summarize(s);
+    s->Add(EF_WritesMemory | EF_Halts);
+}
+
 Location * ArrayAccess::GetEmitLocDeref() {
     Location *t = CG->GenLoad(emit_loc, 0);
+    if (expr_type->IsReferenceType()) t->SetRefKind(HeapRef);
     return t;
 }
 
@@ -513,6 +565,12 @@ FieldAccess::FieldAccess(Expr *b, Identifier *f)
     (field=f)->SetParent(this);
 }
 
+FieldAccess::~FieldAccess() {
+    if (base) delete emit_loc;
+    delete base;
+    delete field;
+}
+
 void FieldAccess::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -618,11 +676,41 @@ void FieldAccess::Emit() {
                 emit_loc->GetName(), base->GetEmitLocDeref());
 }
 
+
+
+
+
+void FieldAccess::Summarize(FnSummary *s) {
+    VarDecl *v = dynamic_cast<VarDecl*>(field->GetDecl());
+    if (base) {
+        base->Summarize(s);
+        if (!dynamic_cast<This*>(base)) s->Add(EF_Halts);
+        s->ReadField();
+    } else if (v && v->IsGlobal()) {
+        s->ReadGlobal();
+    } else if (v && v->IsClassMember()) {
+        s->ReadField();
+    }
+}
+
+void FieldAccess::SummarizeStore(FnSummary *s) {
+    VarDecl *v = dynamic_cast<VarDecl*>(field->GetDecl());
+    if (base) {
+        base->Summarize(s);
+        if (!dynamic_cast<This*>(base)) s->Add(EF_Halts);
+    }
+    if (v && v->IsGlobal() && !base)
+        s->WriteGlobal(field->GetIdName());
+    else if (v && (base || v->IsClassMember()))
+        s->WriteField(field->GetIdName());
+}
+
 Location * FieldAccess::GetEmitLocDeref() {
     Location *t = emit_loc;
     if (t->GetBase() != NULL) {
         
         t = CG->GenLoad(t->GetBase(), t->GetOffset());
+        if (expr_type->IsReferenceType()) t->SetRefKind(HeapRef);
     }
     return t;
 }
@@ -634,6 +722,14 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
     if (base) base->SetParent(this);
     (field=f)->SetParent(this);
     (actuals=a)->SetParentAll(this);
+    effects = EF_All;
+}
+
+Call::~Call() {
+    delete base;
+    delete field;
+    actuals->DeleteAll();
+    delete actuals;
 }
 
 void Call::PrintChildren(int indentLevel) {
@@ -778,19 +874,45 @@ void Call::Emit() {
         
         CG->GenPushParam(this_loc);
         
-        emit_loc = CG->GenACall(t, fn->HasReturnValue());
+        emit_loc = CG->GenACall(t, fn->HasReturnValue(), effects);
+        if (emit_loc && expr_type->IsReferenceType())
+            emit_loc->SetRefKind(HeapRef);
         
         CG->GenPopParams(actuals->NumElements() * 4 + 4);
     } else {
         
         field->AddPrefix("_"); 
         emit_loc = CG->GenLCall(field->GetIdName(),
-                expr_type != Type::voidType);
+                expr_type != Type::voidType, effects);
+        if (emit_loc && expr_type->IsReferenceType())
+            emit_loc->SetRefKind(HeapRef);
         
         CG->GenPopParams(actuals->NumElements() * 4);
     }
 }
 
+
+
+
+
+void Call::Summarize(FnSummary *s) {
+    if (base) {
+        base->Summarize(s);
+        if (!dynamic_cast<This*>(base)) s->Add(EF_Halts);
+    }
+    actuals->SummarizeAll(s);
+    if (base && base->GetType() && base->GetType()->IsArrayType())
+        return;
+
+    FnDecl *fn = dynamic_cast<FnDecl*>(field->GetDecl());
+    Decl *receiver = NULL;
+    if (base && base->GetType() && base->GetType()->IsNamedType())
+        receiver = dynamic_cast<NamedType*>(base->GetType())->GetId()
+                       ->GetDecl();
+    if (fn) s->AddCall(this, fn, receiver);
+    else s->Add(EF_All);
+}
+
 NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc) {
     Assert(c != NULL);
     (cType=c)->SetParent(this);
@@ -828,19 +950,27 @@ void NewExpr::Check(checkT c) {
 void NewExpr::Emit() {
     ClassDecl *d = dynamic_cast<ClassDecl*>(cType->GetId()->GetDecl());
     Assert(d);
-    int size = d->GetInstanceSize();
-    Location *t = CG->GenLoadConstant(size);
-    emit_loc = CG->GenBuiltInCall(Alloc, t);
+    emit_loc = CG->GenAlloc(d->GetInstanceSize(), ObjectBlock);
     Location *l = CG->GenLoadLabel(d->GetId()->GetIdName());
     CG->GenStore(emit_loc, l, 0);
 }
 
+void NewExpr::Summarize(FnSummary *s) {
+    s->Add(CodeGenerator::BuiltInEffects(Alloc));
+    ClassDecl *d = dynamic_cast<ClassDecl*>(cType->GetId()->GetDecl());
+    if (d) s->Instantiate(d);
+}
+
 NewArrayExpr::NewArrayExpr(yyltype loc, Expr *sz, Type *et) : Expr(loc) {
     Assert(sz != NULL && et != NULL);
     (size=sz)->SetParent(this);
     (elemType=et)->SetParent(this);
 }
 
+NewArrayExpr::~NewArrayExpr() {
+    delete size;
+}
+
 void NewArrayExpr::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -892,14 +1022,17 @@ void NewArrayExpr::Emit() {
     CG->GenBuiltInCall(Halt);
 
     CG->GenLabel(l);
-    Location *t4 = CG->GenLoadConstant(1);
-    Location *t5 = CG->GenBinaryOp("+", t4, t0);
-    Location *t6 = CG->GenLoadConstant(elemType->GetTypeSize());
-    Location *t7 = CG->GenBinaryOp("*", t5, t6);
-    Location *t8 = CG->GenBuiltInCall(Alloc, t7);
-    CG->GenStore(t8, t0);
-    Location *t9 = CG->GenBinaryOp("+", t8, t6);
-    emit_loc = t9;
+    Location *t4 = CG->GenLoadConstant(elemType->GetTypeSize());
+    Location *t5 = CG->GenBinaryOp("*", t0, t4);
+    Location *t6 = CG->GenAlloc(t5, elemType->IsReferenceType()
+                                    ? RefArrayBlock : PlainBlock);
+    CG->GenStore(t6, t0, -4);
+    emit_loc = t6;
+}
+
+void NewArrayExpr::Summarize(FnSummary *s) {
+    size->Summarize(s);
+    s->Add(CodeGenerator::BuiltInEffects(Alloc) | EF_Halts);
 }
 
 void ReadIntegerExpr::Check(checkT c) {
@@ -912,6 +1045,10 @@ void ReadIntegerExpr::Emit() {
     emit_loc = CG->GenBuiltInCall(ReadInteger);
 }
 
+void ReadIntegerExpr::Summarize(FnSummary *s) {
+    s->Add(CodeGenerator::BuiltInEffects(ReadInteger));
+}
+
 void ReadLineExpr::Check(checkT c) {
     if (c == E_CheckType) {
         expr_type = Type::stringType;
@@ -920,6 +1057,11 @@ void ReadLineExpr::Check(checkT c) {
 
 void ReadLineExpr::Emit() {
     emit_loc = CG->GenBuiltInCall(ReadLine);
+    emit_loc->SetRefKind(HeapRef);
+}
+
+void ReadLineExpr::Summarize(FnSummary *s) {
+    s->Add(CodeGenerator::BuiltInEffects(ReadLine));
 }
 
 PostfixExpr::PostfixExpr(LValue *lv, Operator *o)
@@ -929,6 +1071,11 @@ PostfixExpr::PostfixExpr(LValue *lv, Operator *o)
     (op=o)->SetParent(this);
 }
 
+PostfixExpr::~PostfixExpr() {
+    delete lvalue;
+    delete op;
+}
+
 void PostfixExpr::PrintChildren(int indentLevel) {
     if (expr_type) std::cout << " <" << expr_type << ">";
     if (emit_loc) emit_loc->Print();
@@ -985,3 +1132,8 @@ void PostfixExpr::Emit() {
     emit_loc = t0;
 }
 
+void PostfixExpr::Summarize(FnSummary *s) {
+    lvalue->Summarize(s);
+    lvalue->SummarizeStore(s);
+}
+
@@ -90,11 +90,12 @@ class BoolConstant : public Expr
 class StringConstant : public Expr
 {
   protected:
-    char *value;
+    const char *value;
+    int len;
 
   public:
     
-    StringConstant(yyltype loc, const char *val);
+    StringConstant(yyltype loc, const TokenText &val);
     
     const char *GetPrintNameForNode() { return "StringConstant"; }
     void PrintChildren(int indentLevel);
@@ -145,8 +146,10 @@ class CompoundExpr : public Expr
     
     CompoundExpr(Expr *lhs, Operator *op, Expr *rhs); 
     CompoundExpr(Operator *op, Expr *rhs);            
+    ~CompoundExpr();
     
     void PrintChildren(int indentLevel);
+    void Summarize(FnSummary *s);
 };
 
 class ArithmeticExpr : public CompoundExpr
@@ -162,6 +165,7 @@ class ArithmeticExpr : public CompoundExpr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckType();
@@ -196,6 +200,7 @@ class EqualityExpr : public CompoundExpr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckType();
@@ -231,6 +236,7 @@ class AssignExpr : public CompoundExpr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckType();
@@ -241,6 +247,10 @@ class LValue : public Expr
   public:
     
     LValue(yyltype loc) : Expr(loc) {}
+
+
+
+    virtual void SummarizeStore(FnSummary *s) { Summarize(s); }
 };
 
 class This : public Expr
@@ -268,6 +278,7 @@ class ArrayAccess : public LValue
   public:
     
     ArrayAccess(yyltype loc, Expr *base, Expr *subscript);
+    ~ArrayAccess();
     
     const char *GetPrintNameForNode() { return "ArrayAccess"; }
     void PrintChildren(int indentLevel);
@@ -275,6 +286,8 @@ class ArrayAccess : public LValue
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
+    void SummarizeStore(FnSummary *s);
     bool IsArrayAccessRef() { return true; }
     Location * GetEmitLocDeref();
 
@@ -292,6 +305,7 @@ class FieldAccess : public LValue
   public:
     
     FieldAccess(Expr *base, Identifier *field); 
+    ~FieldAccess();
     
     const char *GetPrintNameForNode() { return "FieldAccess"; }
     void PrintChildren(int indentLevel);
@@ -299,6 +313,8 @@ class FieldAccess : public LValue
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
+    void SummarizeStore(FnSummary *s);
     Location * GetEmitLocDeref();
 
   protected:
@@ -313,10 +329,12 @@ class Call : public Expr
     Expr *base; 
     Identifier *field;
     List<Expr*> *actuals;
+    int effects;
 
   public:
     
     Call(yyltype loc, Expr *base, Identifier *field, List<Expr*> *args);
+    ~Call();
     
     const char *GetPrintNameForNode() { return "Call"; }
     void PrintChildren(int indentLevel);
@@ -324,6 +342,8 @@ class Call : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
+    void SetEffects(int e) { effects = e; }
 
   protected:
     void CheckDecl();
@@ -346,6 +366,7 @@ class NewExpr : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckDecl();
@@ -361,6 +382,7 @@ class NewArrayExpr : public Expr
   public:
     
     NewArrayExpr(yyltype loc, Expr *sizeExpr, Type *elemType);
+    ~NewArrayExpr();
     
     const char *GetPrintNameForNode() { return "NewArrayExpr"; }
     void PrintChildren(int indentLevel);
@@ -368,6 +390,7 @@ class NewArrayExpr : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckType();
@@ -384,6 +407,7 @@ class ReadIntegerExpr : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 };
 
 class ReadLineExpr : public Expr
@@ -397,6 +421,7 @@ class ReadLineExpr : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 };
 
 class PostfixExpr : public Expr
@@ -407,6 +432,7 @@ class PostfixExpr : public Expr
   public:
     
     PostfixExpr(LValue *lv, Operator *op);
+    ~PostfixExpr();
     
     const char *GetPrintNameForNode() { return "PostfixExpr"; }
     void PrintChildren(int indentLevel);
@@ -414,6 +440,7 @@ class PostfixExpr : public Expr
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void CheckType();
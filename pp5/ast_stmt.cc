@@ -1,13 +1,27 @@
 
 
+#include <list>
+#include <string>
+#include <vector>
 #include "ast_decl.h"
 #include "ast_expr.h"
 #include "ast_stmt.h"
 #include "ast_type.h"
+#include "callgraph.h"
+#include "context.h"
+#include "fncache.h"
+#include "mips.h"
+#include "optimizer.h"
+#include "parallel.h"
+#include "stats.h"
+#include "tacfile.h"
 
 Program::Program(List<Decl*> *d) {
     Assert(d != NULL);
     (decls=d)->SetParentAll(this);
+    cache = NULL;
+    tacOut = NULL;
+    passes = NULL;
 }
 
 void Program::PrintChildren(int indentLevel) {
@@ -20,23 +34,44 @@ void Program::Check() {
     if (IsDebugOn("ast")) { this->Print(0); }
 
     
-    ScopeM = new scopeST(); decls->CheckAll(E_BuildST);
+    {
+        PhaseTimer t("build-st");
+        CompilationContext *ctx = CompilationContext::Current();
+        ScopeM = ctx->scopes = new scopeST(); decls->CheckAll(E_BuildST);
+    }
     if (IsDebugOn("st")) { ScopeM->Print(); }
     
     if (IsDebugOn("ast+")) { this->Print(0); }
 
     
-    ScopeM->ReEnter(); decls->CheckAll(E_CheckDecl);
+    {
+        PhaseTimer t("check-decl");
+        ScopeM->ReEnter(); decls->CheckAll(E_CheckDecl);
+    }
     
     if (IsDebugOn("ast+")) { this->Print(0); }
 
     
-    ScopeM->ReEnter(); decls->CheckAll(E_CheckInherit);
+    {
+        PhaseTimer t("check-inherit");
+        ScopeM->ReEnter(); decls->CheckAll(E_CheckInherit);
+    }
     
     if (IsDebugOn("ast+")) { this->Print(0); }
 
     
-    ScopeM->ReEnter(); decls->CheckAll(E_CheckType);
+    {
+        PhaseTimer t("check-type");
+        ScopeM->ReEnter();
+        int jobs = CompilationContext::Current()->jobs;
+        if (jobs > 1) {
+            ParallelCheck pc(jobs);
+            decls->CheckAll(E_CheckType);
+            pc.Finish();
+        } else {
+            decls->CheckAll(E_CheckType);
+        }
+    }
     
     if (IsDebugOn("ast+")) { this->Print(0); }
 }
@@ -59,24 +94,256 @@ void Program::Emit() {
         ReportError::NoMainFound();
         return;
     }
+    CG = CompilationContext::Current()->cg = new CodeGenerator();
 
     
     
-    for (int i = 0; i < decls->NumElements(); i++) {
-        decls->Nth(i)->AssignOffset();
+    {
+        PhaseTimer t("layout");
+        for (int i = 0; i < decls->NumElements(); i++) {
+            decls->Nth(i)->AssignOffset();
+        }
+        
+        for (int i = 0; i < decls->NumElements(); i++) {
+            decls->Nth(i)->AddPrefixToMethods();
+        }
     }
+    if (IsDebugOn("tac+")) { this->Print(0); }
+
+    
     
+    
+    CallGraph *calls = new CallGraph(decls);
+    calls->FindReachable();
+    if (IsDebugOn("effects")) calls->PrintReport(stderr);
+
+    
+    
+    
+    List<Decl*> *units = new List<Decl*>;
+    List<Decl*> dead;
     for (int i = 0; i < decls->NumElements(); i++) {
-        decls->Nth(i)->AddPrefixToMethods();
+        Decl *d = decls->Nth(i);
+        if (d->IsFnDecl()) {
+            bool live = dynamic_cast<FnDecl*>(d)->IsReachable();
+            (live ? units : &dead)->Append(d);
+        } else if (d->IsClassDecl()) {
+            ClassDecl *c = dynamic_cast<ClassDecl*>(d);
+            List<VarDecl*> vars;
+            List<FnDecl*> fns;
+            c->AddMembersToList(&vars, &fns);
+            for (int j = 0; j < fns.NumElements(); j++) {
+                FnDecl *fn = fns.Nth(j);
+                (fn->IsReachable() ? units : &dead)->Append(fn);
+            }
+            (c->IsInstantiated() ? units : &dead)->Append(c);
+        } else {
+            d->Emit();
+        }
     }
-    if (IsDebugOn("tac+")) { this->Print(0); }
 
     
-    decls->EmitAll();
+    
+    const char *saveTac = GetOption("save-tac");
+    passes = PassManager::ForContext();
+    if (saveTac)
+        tacOut = new TacWriter;
+    else if (CompilationContext::Current()->bisectLimit < 0)
+        cache = FnCache::Open(decls);
+    if (GetOption("stream"))
+        this->StreamUnits(units);
+    else
+        this->EmitUnits(units);
+    if (!IsDebugOn("tac")) {
+        std::vector<int> roots;
+        std::vector<std::string> memos;
+        for (int i = 0; i < decls->NumElements(); i++) {
+            Location *l = decls->Nth(i)->GetEmitLoc();
+            if (decls->Nth(i)->IsVarDecl() && l->GetRefKind() == HeapRef)
+                roots.push_back(l->GetOffset());
+            FnDecl *fn = dynamic_cast<FnDecl*>(decls->Nth(i));
+            if (fn && fn->IsReachable() && fn->GetMemoKeys() >= 0)
+                memos.push_back(fn->GetId()->GetIdName());
+        }
+        Mips mips;
+        mips.EmitGlobalRoots(roots, memos);
+    }
+    if (tacOut && !tacOut->WriteTo(saveTac))
+        ReportError::Formatted(NULL, "Unable to write TAC to '%s'", saveTac);
+    if (passes && IsDebugOn("passes"))
+        passes->PrintReport(stderr);
+    if (IsDebugOn("deadcode"))
+        this->ReportDeadCode(&dead);
+    delete cache;
+    delete tacOut;
+    delete passes;
+    cache = NULL;
+    tacOut = NULL;
+    passes = NULL;
+    delete units;
+    delete calls;
+}
+
+
+
+static CodeGenerator *LowerUnit(Decl *d, int unit, PassManager *passes) {
+    CG = new CodeGenerator(unit);
+    if (d->IsClassDecl())
+        dynamic_cast<ClassDecl*>(d)->EmitVTable();
+    else
+        d->Emit();
+    if (passes) passes->Run(CG);
+    return CG;
+}
+
+void Program::ReportDeadCode(List<Decl*> *dead) {
+    CodeGenerator *global = CG;
+    long total = 0;
+    fprintf(stderr, "\n======== Dead code ========\n");
+    for (int i = 0; i < dead->NumElements(); i++) {
+        Decl *d = dead->Nth(i);
+        CodeGenerator *cg = LowerUnit(d, i + 1, passes);
+        std::string text;
+        cg->EmitMips(&text);
+        delete cg;
+        total += text.size();
+        fprintf(stderr, "%-24s %-8s %6zu bytes\n", d->GetId()->GetIdName(),
+                d->IsClassDecl() ? "vtable" : "function", text.size());
+    }
+    CG = global;
+    fprintf(stderr, "removed %d units, %ld bytes of assembly\n",
+            dead->NumElements(), total);
+    fprintf(stderr, "======== Dead code ========\n");
+}
+
+void Program::EmitUnits(List<Decl*> *units) {
+    int n = units->NumElements();
+    std::vector<CodeGenerator*> gens(n);
+    std::vector<std::string> text(n);
+    std::vector<uint64_t> keys(n);
+    CompilationContext *ctx = CompilationContext::Current();
+    int jobs = ctx->jobs;
+    ThreadPool *pool = (jobs > 1 && n > 1) ? new ThreadPool(jobs) : NULL;
+    CodeGenerator *global = CG;
+    bool tac = IsDebugOn("tac");
+
+    auto forEachUnit = [&](std::function<void(int)> fn) {
+        for (int i = 0; i < n; i++) {
+            if (pool)
+                pool->Submit([&fn, i] { fn(i); });
+            else
+                fn(i);
+        }
+        if (pool) pool->WaitAll();
+    };
+
+    {
+        PhaseTimer t("tac-gen");
+        forEachUnit([&](int i) {
+            Decl *d = units->Nth(i);
+            keys[i] = 0;
+            if (cache && d->IsFnDecl()) {
+                keys[i] = cache->Key(dynamic_cast<FnDecl*>(d), i + 1);
+                if (cache->Lookup(keys[i], tac, &text[i])) {
+                    Stats::Count(S_CacheHits);
+                    gens[i] = NULL;
+                    return;
+                }
+                Stats::Count(S_CacheMisses);
+            }
+            gens[i] = LowerUnit(d, i + 1, tacOut ? NULL : passes);
+        });
+    }
+    CG = global;
     if (IsDebugOn("tac+")) { this->Print(0); }
+    for (int i = 0; tacOut && i < n; i++)
+        gens[i]->Save(tacOut);
+    if (tacOut && passes)
+        forEachUnit([&](int i) { passes->Run(gens[i]); });
 
     
-    CG->DoFinalCodeGen();
+    {
+        PhaseTimer t("mips-emit");
+        forEachUnit([&](int i) {
+            if (!gens[i]) return;
+            if (keys[i]) {
+                std::string tacText, mipsText;
+                FnCache::Render(gens[i], &tacText, &mipsText);
+                cache->Store(keys[i], tacText, mipsText);
+                text[i] = tac ? tacText : mipsText;
+            } else if (!tac) {
+                gens[i]->EmitMips(&text[i]);
+            }
+        });
+
+        if (!tac) {
+            Mips mips;
+            mips.EmitPreamble();
+        }
+        for (int i = 0; i < n; i++) {
+            if (tac && gens[i] && !keys[i])
+                gens[i]->PrintTac(ctx->out);
+            else
+                fputs(text[i].c_str(), ctx->out);
+        }
+    }
+
+    delete pool;
+    for (int i = 0; i < n; i++)
+        delete gens[i];
+}
+
+
+
+
+void Program::StreamUnits(List<Decl*> *units) {
+    CodeGenerator *global = CG;
+    FILE *out = CompilationContext::Current()->out;
+    bool tac = IsDebugOn("tac");
+    if (!tac) {
+        Mips mips;
+        mips.EmitPreamble();
+    }
+
+    for (int i = 0; i < units->NumElements(); i++) {
+        Decl *d = units->Nth(i);
+        FnDecl *fn = d->IsFnDecl() ? dynamic_cast<FnDecl*>(d) : NULL;
+        uint64_t key = (cache && fn) ? cache->Key(fn, i + 1) : 0;
+        std::string text;
+        if (key && cache->Lookup(key, tac, &text)) {
+            Stats::Count(S_CacheHits);
+            fputs(text.c_str(), out);
+            fn->ReleaseBody();
+            continue;
+        }
+        if (key) Stats::Count(S_CacheMisses);
+
+        CodeGenerator *cg;
+        {
+            PhaseTimer t("tac-gen");
+            cg = LowerUnit(d, i + 1, tacOut ? NULL : passes);
+        }
+        if (tacOut) {
+            cg->Save(tacOut);
+            if (passes) passes->Run(cg);
+        }
+        {
+            PhaseTimer t("mips-emit");
+            if (key) {
+                std::string tacText, mipsText;
+                FnCache::Render(cg, &tacText, &mipsText);
+                cache->Store(key, tacText, mipsText);
+                fputs((tac ? tacText : mipsText).c_str(), out);
+            } else if (tac) {
+                cg->PrintTac(out);
+            } else {
+                cg->EmitMips(NULL);
+            }
+        }
+        delete cg;
+        if (fn) fn->ReleaseBody();
+    }
+    CG = global;
 }
 
 StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s) {
@@ -85,6 +352,13 @@ StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s) {
     (stmts=s)->SetParentAll(this);
 }
 
+StmtBlock::~StmtBlock() {
+    decls->DeleteAll();
+    stmts->DeleteAll();
+    delete decls;
+    delete stmts;
+}
+
 void StmtBlock::PrintChildren(int indentLevel) {
     decls->PrintAll(indentLevel+1);
     stmts->PrintAll(indentLevel+1);
@@ -113,18 +387,37 @@ void StmtBlock::Emit() {
     stmts->EmitAll();
 }
 
+void StmtBlock::Summarize(FnSummary *s) {
+    stmts->SummarizeAll(s);
+}
+
 ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) {
     Assert(t != NULL && b != NULL);
     (test=t)->SetParent(this);
     (body=b)->SetParent(this);
 }
 
+ConditionalStmt::~ConditionalStmt() {
+    delete test;
+    delete body;
+}
+
+void ConditionalStmt::Summarize(FnSummary *s) {
+    test->Summarize(s);
+    body->Summarize(s);
+}
+
 ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b): LoopStmt(t, b) {
     Assert(i != NULL && t != NULL && s != NULL && b != NULL);
     (init=i)->SetParent(this);
     (step=s)->SetParent(this);
 }
 
+ForStmt::~ForStmt() {
+    delete init;
+    delete step;
+}
+
 void ForStmt::PrintChildren(int indentLevel) {
     init->Print(indentLevel+1, "(init) ");
     test->Print(indentLevel+1, "(test) ");
@@ -184,6 +477,12 @@ void ForStmt::Emit() {
     CG->GenLabel(l1);
 }
 
+void ForStmt::Summarize(FnSummary *s) {
+    init->Summarize(s);
+    step->Summarize(s);
+    LoopStmt::Summarize(s);
+}
+
 void WhileStmt::PrintChildren(int indentLevel) {
     test->Print(indentLevel+1, "(test) ");
     body->Print(indentLevel+1, "(body) ");
@@ -241,6 +540,10 @@ IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb) {
     if (elseBody) elseBody->SetParent(this);
 }
 
+IfStmt::~IfStmt() {
+    delete elseBody;
+}
+
 void IfStmt::PrintChildren(int indentLevel) {
     test->Print(indentLevel+1, "(test) ");
     body->Print(indentLevel+1, "(then) ");
@@ -307,6 +610,11 @@ void IfStmt::Emit() {
     CG->GenLabel(l1);
 }
 
+void IfStmt::Summarize(FnSummary *s) {
+    ConditionalStmt::Summarize(s);
+    if (elseBody) elseBody->Summarize(s);
+}
+
 void BreakStmt::Check(checkT c) {
     if (c == E_CheckType) {
         Node *n = this;
@@ -345,6 +653,13 @@ CaseStmt::CaseStmt(IntConstant *v, List<Stmt*> *s) {
     case_label = NULL;
 }
 
+CaseStmt::~CaseStmt() {
+    delete value;
+    stmts->DeleteAll();
+    delete stmts;
+    free((char *)case_label);
+}
+
 void CaseStmt::PrintChildren(int indentLevel) {
     if (value) value->Print(indentLevel+1);
     stmts->PrintAll(indentLevel+1);
@@ -376,6 +691,10 @@ void CaseStmt::Emit() {
     stmts->EmitAll();
 }
 
+void CaseStmt::Summarize(FnSummary *s) {
+    stmts->SummarizeAll(s);
+}
+
 SwitchStmt::SwitchStmt(Expr *e, List<CaseStmt*> *c) {
     Assert(e != NULL && c != NULL);
     (expr=e)->SetParent(this);
@@ -383,6 +702,13 @@ SwitchStmt::SwitchStmt(Expr *e, List<CaseStmt*> *c) {
     end_switch_label = NULL;
 }
 
+SwitchStmt::~SwitchStmt() {
+    delete expr;
+    cases->DeleteAll();
+    delete cases;
+    free((char *)end_switch_label);
+}
+
 void SwitchStmt::PrintChildren(int indentLevel) {
     expr->Print(indentLevel+1);
     cases->PrintAll(indentLevel+1);
@@ -446,11 +772,20 @@ void SwitchStmt::Emit() {
     CG->GenLabel(end_switch_label);
 }
 
+void SwitchStmt::Summarize(FnSummary *s) {
+    expr->Summarize(s);
+    cases->SummarizeAll(s);
+}
+
 ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc) {
     Assert(e != NULL);
     (expr=e)->SetParent(this);
 }
 
+ReturnStmt::~ReturnStmt() {
+    delete expr;
+}
+
 void ReturnStmt::PrintChildren(int indentLevel) {
     expr->Print(indentLevel+1);
 }
@@ -479,15 +814,30 @@ void ReturnStmt::Emit() {
         CG->GenReturn();
     } else {
         expr->Emit();
-        CG->GenReturn(expr->GetEmitLocDeref());
+        Location *val = expr->GetEmitLocDeref();
+        Node *n = this;
+        while (n && dynamic_cast<FnDecl*>(n) == NULL)
+            n = n->GetParent();
+        FnDecl *fn = dynamic_cast<FnDecl*>(n);
+        if (fn && fn->GetMemoKeys() >= 0) fn->EmitMemoStore(val);
+        CG->GenReturn(val);
     }
 }
 
+void ReturnStmt::Summarize(FnSummary *s) {
+    expr->Summarize(s);
+}
+
 PrintStmt::PrintStmt(List<Expr*> *a) {
     Assert(a != NULL);
     (args=a)->SetParentAll(this);
 }
 
+PrintStmt::~PrintStmt() {
+    args->DeleteAll();
+    delete args;
+}
+
 void PrintStmt::PrintChildren(int indentLevel) {
     args->PrintAll(indentLevel+1, "(args) ");
 }
@@ -505,22 +855,69 @@ void PrintStmt::Check(checkT c) {
     }
 }
 
+static bool PerformsIO(std::list<Instruction*>::iterator p,
+                   std::list<Instruction*>::iterator end) {
+    for (; p != end; ++p)
+        if ((*p)->GetEffects() & EF_IO) return true;
+    return false;
+}
+
+static bool Overwrites(std::list<Instruction*>::iterator p,
+                       std::list<Instruction*>::iterator end,
+                       List<Location*> *pending) {
+    for (; p != end; ++p) {
+        Location *dst = (*p)->GetDst();
+        bool globals = ((*p)->GetEffects() & EF_WritesGlobals) != 0;
+        for (int i = 0; i < pending->NumElements(); i++) {
+            Location *l = pending->Nth(i);
+            if (l == dst || (globals && l->GetSegment() == gpRelative))
+                return true;
+        }
+    }
+    return false;
+}
+
+
+
+
 void PrintStmt::Emit() {
+    std::list<Instruction*> *code = CG->GetCode();
+    List<Location*> *pending = new List<Location*>;
+    std::string tags;
     for (int i = 0; i < args->NumElements(); i++) {
+        Assert(!code->empty());
+        std::list<Instruction*>::iterator last = --code->end();
         args->Nth(i)->Emit();
-        
+        ++last;
+
+        if (pending->NumElements() > 0 && (PerformsIO(last, code->end())
+                || Overwrites(last, code->end(), pending))) {
+            std::list<Instruction*> arg;
+            arg.splice(arg.begin(), *code, last, code->end());
+            CG->GenPrint(tags.c_str(), pending);
+            code->splice(code->end(), arg);
+            pending = new List<Location*>;
+            tags.clear();
+        }
+
         Type *t = args->Nth(i)->GetType();
-        BuiltIn f;
         if (t == Type::intType) {
-            f = PrintInt;
+            tags += 'i';
         } else if (t == Type::stringType) {
-            f = PrintString;
+            tags += 's';
         } else {
-            f = PrintBool;
+            tags += 'b';
         }
         Location *l = args->Nth(i)->GetEmitLocDeref();
         Assert(l);
-        CG->GenBuiltInCall(f, l);
+        pending->Append(l);
     }
+    if (pending->NumElements() > 0)
+        CG->GenPrint(tags.c_str(), pending);
+}
+
+void PrintStmt::Summarize(FnSummary *s) {
+    args->SummarizeAll(s);
+    s->Add(CodeGenerator::BuiltInEffects(::Print));
 }
 
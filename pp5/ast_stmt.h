@@ -9,11 +9,17 @@
 class Decl;
 class VarDecl;
 class Expr;
+class FnCache;
+class PassManager;
+class TacWriter;
 
 class Program : public Node
 {
   protected:
     List<Decl*> *decls;
+    FnCache *cache;
+    TacWriter *tacOut;
+    PassManager *passes;
 
   public:
     
@@ -26,6 +32,11 @@ class Program : public Node
     void Check(checkT c) { Check(); }
     
     void Emit();
+
+  protected:
+    void EmitUnits(List<Decl*> *units);
+    void StreamUnits(List<Decl*> *units);
+    void ReportDeadCode(List<Decl*> *dead);
 };
 
 class Stmt : public Node
@@ -45,6 +56,7 @@ class StmtBlock : public Stmt
   public:
     
     StmtBlock(List<VarDecl*> *variableDeclarations, List<Stmt*> *statements);
+    ~StmtBlock();
     
     const char *GetPrintNameForNode() { return "StmtBlock"; }
     void PrintChildren(int indentLevel);
@@ -52,6 +64,7 @@ class StmtBlock : public Stmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void BuildST();
@@ -67,6 +80,9 @@ class ConditionalStmt : public Stmt
   public:
     
     ConditionalStmt(Expr *testExpr, Stmt *body);
+    ~ConditionalStmt();
+
+    void Summarize(FnSummary *s);
 };
 
 class LoopStmt : public ConditionalStmt
@@ -78,6 +94,7 @@ class LoopStmt : public ConditionalStmt
     
     LoopStmt(Expr *testExpr, Stmt *body)
             : ConditionalStmt(testExpr, body) { end_loop_label = NULL; }
+    ~LoopStmt() { free((char *)end_loop_label); }
     
     bool IsLoopStmt() { return true; }
     
@@ -92,6 +109,7 @@ class ForStmt : public LoopStmt
   public:
     
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
+    ~ForStmt();
     
     const char *GetPrintNameForNode() { return "ForStmt"; }
     void PrintChildren(int indentLevel);
@@ -99,6 +117,7 @@ class ForStmt : public LoopStmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void BuildST();
@@ -131,6 +150,7 @@ class IfStmt : public ConditionalStmt
   public:
     
     IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
+    ~IfStmt();
     
     const char *GetPrintNameForNode() { return "IfStmt"; }
     void PrintChildren(int indentLevel);
@@ -138,6 +158,7 @@ class IfStmt : public ConditionalStmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 
   protected:
     void BuildST();
@@ -169,6 +190,7 @@ class CaseStmt : public Stmt
   public:
     
     CaseStmt(IntConstant *v, List<Stmt*> *stmts);
+    ~CaseStmt();
     
     const char *GetPrintNameForNode() { return value ? "Case" : "Default"; }
     void PrintChildren(int indentLevel);
@@ -177,6 +199,7 @@ class CaseStmt : public Stmt
     bool IsCaseStmt() { return value ? true : false; }
     
     void Emit();
+    void Summarize(FnSummary *s);
     void GenCaseLabel();
     const char * GetCaseLabel() { return case_label; }
     IntConstant * GetCaseValue() { return value; }
@@ -195,6 +218,7 @@ class SwitchStmt : public Stmt
   public:
     
     SwitchStmt(Expr *expr, List<CaseStmt*> *cases);
+    ~SwitchStmt();
     
     const char *GetPrintNameForNode() { return "SwitchStmt"; }
     void PrintChildren(int indentLevel);
@@ -202,6 +226,7 @@ class SwitchStmt : public Stmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
     bool IsSwitchStmt() { return true; }
     const char * GetEndSwitchLabel() { return end_switch_label; }
 
@@ -217,6 +242,7 @@ class ReturnStmt : public Stmt
   public:
     
     ReturnStmt(yyltype loc, Expr *expr);
+    ~ReturnStmt();
     
     const char *GetPrintNameForNode() { return "ReturnStmt"; }
     void PrintChildren(int indentLevel);
@@ -224,6 +250,7 @@ class ReturnStmt : public Stmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 };
 
 class PrintStmt : public Stmt
@@ -234,6 +261,7 @@ class PrintStmt : public Stmt
   public:
     
     PrintStmt(List<Expr*> *arguments);
+    ~PrintStmt();
     
     const char *GetPrintNameForNode() { return "PrintStmt"; }
     void PrintChildren(int indentLevel);
@@ -241,6 +269,7 @@ class PrintStmt : public Stmt
     void Check(checkT c);
     
     void Emit();
+    void Summarize(FnSummary *s);
 };
 
 #endif
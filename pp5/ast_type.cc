@@ -1,5 +1,6 @@
 
 
+#include <mutex>
 #include <string.h>
 #include "ast_decl.h"
 #include "ast_type.h"
@@ -29,14 +30,19 @@ void Type::PrintChildren(int indentLevel) {
 
 void Type::Check(checkT c) {
     if (c == E_CheckDecl) {
-        Type::intType->SetSelfType();
-        Type::doubleType->SetSelfType();
-        Type::voidType->SetSelfType();
-        Type::boolType->SetSelfType();
-        Type::nullType->SetSelfType();
-        Type::stringType->SetSelfType();
-        Type::errorType->SetSelfType();
-        expr_type = this;
+        
+        
+        static std::once_flag builtins;
+        std::call_once(builtins, [] {
+            Type::intType->SetSelfType();
+            Type::doubleType->SetSelfType();
+            Type::voidType->SetSelfType();
+            Type::boolType->SetSelfType();
+            Type::nullType->SetSelfType();
+            Type::stringType->SetSelfType();
+            Type::errorType->SetSelfType();
+        });
+        if (expr_type != this) expr_type = this;
     }
 }
 
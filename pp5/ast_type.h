@@ -29,8 +29,12 @@ class Type : public Node
     void Check(checkT c);
     virtual void Check(checkT c, reasonT r) { Check(c); }
     virtual bool IsBasicType() { return !IsNamedType() && !IsArrayType(); }
+
+
+    void SetParent(Node *p) { if (!IsBasicType()) Node::SetParent(p); }
     virtual bool IsNamedType() { return false; }
     virtual bool IsArrayType() { return false; }
+    bool IsReferenceType() { return !IsBasicType() || this == stringType; }
     virtual bool IsEquivalentTo(Type *other) { return this == other; }
     virtual bool IsCompatibleWith(Type *other) { return this == other; }
     char * GetTypeName() { return typeName; }
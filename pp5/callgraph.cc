@@ -0,0 +1,302 @@
+
+
+#include "callgraph.h"
+#include <string.h>
+#include "ast_decl.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
+#include "stats.h"
+#include "utility.h"
+
+static const int MaxMemoKeys = 4, MinRecursiveCalls = 2;
+
+FnSummary::FnSummary(FnDecl *f, ClassDecl *o)
+  : fn(f), owner(o), effects(0), opaque(false) {}
+
+void FnSummary::WriteGlobal(const char *name) {
+    effects |= EF_WritesGlobals;
+    globals.insert(name);
+}
+
+void FnSummary::WriteField(const char *name) {
+    effects |= EF_WritesMemory;
+    fields.insert(name);
+}
+
+void FnSummary::AddCall(Call *call, FnDecl *callee, Decl *receiver) {
+    Site site = { call, callee, receiver, std::vector<FnSummary*>(), false };
+    sites.push_back(site);
+}
+
+CallGraph::CallGraph(List<Decl*> *decls) : anySlot(false) {
+    PhaseTimer t("effects");
+    for (int i = 0; i < decls->NumElements(); i++) {
+        Decl *d = decls->Nth(i);
+        if (d->IsFnDecl()) {
+            FnDecl *fn = dynamic_cast<FnDecl*>(d);
+            summaries.push_back(byFn[fn] = new FnSummary(fn, NULL));
+        } else if (d->IsClassDecl()) {
+            ClassDecl *c = dynamic_cast<ClassDecl*>(d);
+            List<VarDecl*> vars;
+            List<FnDecl*> fns;
+            c->AddMembersToList(&vars, &fns);
+            for (int j = 0; j < fns.NumElements(); j++) {
+                FnDecl *fn = fns.Nth(j);
+                summaries.push_back(byFn[fn] = new FnSummary(fn, c));
+            }
+            classes.push_back(c);
+        }
+    }
+
+    for (int i = 0; i < summaries.size(); i++)
+        summaries[i]->fn->Summarize(summaries[i]);
+    for (int i = 0; i < summaries.size(); i++)
+        Resolve(summaries[i]);
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int i = 0; i < summaries.size(); i++)
+            changed |= Propagate(summaries[i]);
+    }
+    for (int i = 0; i < summaries.size(); i++)
+        Annotate(summaries[i]);
+    for (int i = 0; GetOption("memoize") && i < summaries.size(); i++)
+        ChooseMemo(summaries[i]);
+}
+
+CallGraph::~CallGraph() {
+    for (int i = 0; i < summaries.size(); i++)
+        delete summaries[i];
+}
+
+FnSummary *CallGraph::SummaryOf(FnDecl *fn) {
+    auto it = byFn.find(fn);
+    return it == byFn.end() ? NULL : it->second;
+}
+
+
+
+
+
+
+void CallGraph::Resolve(FnSummary *s) {
+    for (int i = 0; i < s->sites.size(); i++) {
+        FnSummary::Site &site = s->sites[i];
+        Decl *receiver = site.receiver;
+        if (!receiver && site.callee->IsClassMember()) receiver = s->owner;
+        site.receiver = receiver;
+        if (!receiver) {
+            FnSummary *t = SummaryOf(site.callee);
+            if (t) site.targets.push_back(t);
+            else site.unknown = true;
+            continue;
+        }
+
+        int offset = site.callee->GetVTableOffset();
+        if (offset < 0) {
+            site.unknown = true;
+            continue;
+        }
+        for (int k = 0; k < classes.size() && !site.unknown; k++) {
+            if (!classes[k]->IsChildOf(receiver)) continue;
+            List<FnDecl*> *methods = classes[k]->GetMethods();
+            FnSummary *t = methods && offset / 4 < methods->NumElements()
+                         ? SummaryOf(methods->Nth(offset / 4)) : NULL;
+            if (!t) site.unknown = true;
+            bool seen = false;
+            for (int j = 0; j < site.targets.size(); j++)
+                seen |= site.targets[j] == t;
+            if (t && !seen) site.targets.push_back(t);
+        }
+    }
+}
+
+bool CallGraph::Propagate(FnSummary *s) {
+    int effects = s->effects;
+    bool opaque = s->opaque;
+    size_t globals = s->globals.size(), fields = s->fields.size();
+    for (int i = 0; i < s->sites.size(); i++) {
+        FnSummary::Site &site = s->sites[i];
+        if (site.unknown) {
+            s->effects = EF_All;
+            s->opaque = true;
+        }
+        for (int k = 0; k < site.targets.size(); k++) {
+            FnSummary *t = site.targets[k];
+            s->effects |= t->effects;
+            s->opaque |= t->opaque;
+            s->globals.insert(t->globals.begin(), t->globals.end());
+            s->fields.insert(t->fields.begin(), t->fields.end());
+        }
+    }
+    return s->effects != effects || s->opaque != opaque
+        || s->globals.size() != globals || s->fields.size() != fields;
+}
+
+void CallGraph::Annotate(FnSummary *s) {
+    for (int i = 0; i < s->sites.size(); i++) {
+        FnSummary::Site &site = s->sites[i];
+        int effects = site.unknown ? EF_All : 0;
+        for (int k = 0; k < site.targets.size(); k++)
+            effects |= site.targets[k]->effects;
+        site.call->SetEffects(effects);
+    }
+    s->fn->SetEffects(s->effects);
+}
+
+bool CallGraph::Reaches(FnSummary *from, FnSummary *to) {
+    std::set<FnSummary*> seen;
+    std::vector<FnSummary*> work(1, from);
+    while (!work.empty()) {
+        FnSummary *s = work.back();
+        work.pop_back();
+        if (s == to) return true;
+        if (!seen.insert(s).second) continue;
+        for (int i = 0; i < s->sites.size(); i++)
+            work.insert(work.end(), s->sites[i].targets.begin(),
+                        s->sites[i].targets.end());
+    }
+    return false;
+}
+
+
+
+
+
+void CallGraph::ChooseMemo(FnSummary *s) {
+    FnDecl *fn = s->fn;
+    List<VarDecl*> *formals = fn->GetFormals();
+    int n = formals->NumElements();
+    if (s->owner || s->opaque || (s->effects & ~EF_Halts)
+        || !strcmp(fn->GetId()->GetIdName(), "main")
+        || n == 0 || n > MaxMemoKeys)
+        return;
+    if (fn->GetType() != Type::intType && fn->GetType() != Type::boolType)
+        return;
+    for (int i = 0; i < n; i++) {
+        Type *t = formals->Nth(i)->GetType();
+        if (t != Type::intType && t != Type::boolType) return;
+    }
+
+    int recursive = 0;
+    for (int i = 0; i < s->sites.size(); i++) {
+        if (dynamic_cast<ReturnStmt*>(s->sites[i].call->GetParent()))
+            continue;
+        std::vector<FnSummary*> &targets = s->sites[i].targets;
+        bool back = false;
+        for (int k = 0; k < targets.size() && !back; k++)
+            back = Reaches(targets[k], s);
+        if (back) recursive++;
+    }
+    if (recursive >= MinRecursiveCalls)
+        fn->SetMemoKeys(n == 1 ? 0 : n);
+}
+
+void CallGraph::ReachFn(FnSummary *s) {
+    if (s && reached.insert(s).second) work.push_back(s);
+}
+
+void CallGraph::ReachSlot(ClassDecl *c, Decl *receiver, int offset) {
+    List<FnDecl*> *methods = c->GetMethods();
+    if (!c->IsChildOf(receiver) || !methods
+        || offset / 4 >= methods->NumElements())
+        return;
+    ReachFn(SummaryOf(methods->Nth(offset / 4)));
+}
+
+void CallGraph::ReachClass(ClassDecl *c) {
+    if (!live.insert(c).second) return;
+    for (int i = 0; i < slots.size(); i++)
+        ReachSlot(c, slots[i].first, slots[i].second);
+    List<FnDecl*> *methods = c->GetMethods();
+    for (int i = 0; anySlot && methods && i < methods->NumElements(); i++)
+        ReachFn(SummaryOf(methods->Nth(i)));
+}
+
+
+
+
+
+
+
+
+
+void CallGraph::FindReachable() {
+    FnSummary *main = NULL;
+    for (int i = 0; i < summaries.size(); i++)
+        if (!summaries[i]->owner
+            && !strcmp(summaries[i]->fn->GetId()->GetIdName(), "main"))
+            main = summaries[i];
+    if (!main) return;
+
+    ReachFn(main);
+    while (!work.empty()) {
+        FnSummary *s = work.back();
+        work.pop_back();
+        for (int i = 0; i < s->classes.size(); i++)
+            ReachClass(s->classes[i]);
+        for (int i = 0; i < s->sites.size(); i++) {
+            FnSummary::Site &site = s->sites[i];
+            if (site.unknown && !anySlot) {
+                anySlot = true;
+                for (auto it = live.begin(); it != live.end(); ++it) {
+                    List<FnDecl*> *methods = (*it)->GetMethods();
+                    for (int k = 0; methods && k < methods->NumElements(); k++)
+                        ReachFn(SummaryOf(methods->Nth(k)));
+                }
+            }
+            if (site.unknown) continue;
+            if (!site.receiver) {
+                for (int k = 0; k < site.targets.size(); k++)
+                    ReachFn(site.targets[k]);
+                continue;
+            }
+            int offset = site.callee->GetVTableOffset();
+            slots.push_back(std::make_pair(site.receiver, offset));
+            for (auto it = live.begin(); it != live.end(); ++it)
+                ReachSlot(*it, site.receiver, offset);
+        }
+    }
+
+    for (int i = 0; i < summaries.size(); i++)
+        summaries[i]->fn->SetReachable(reached.count(summaries[i]) > 0);
+    for (int i = 0; i < classes.size(); i++)
+        classes[i]->SetInstantiated(live.count(classes[i]) > 0);
+}
+
+static const char *Kind(int effects) {
+    if (!(effects & ~(EF_ReadsGlobals | EF_ReadsMemory | EF_Halts)))
+        return effects & (EF_ReadsGlobals | EF_ReadsMemory) ? "reads-only"
+                                                            : "pure";
+    return "impure";
+}
+
+static void PrintNames(FILE *out, const char *what,
+                       const std::set<std::string> &names) {
+    if (names.empty()) return;
+    fprintf(out, " %s {", what);
+    for (auto it = names.begin(); it != names.end(); ++it)
+        fprintf(out, "%s%s", it == names.begin() ? "" : ",", it->c_str());
+    fprintf(out, "}");
+}
+
+void CallGraph::PrintReport(FILE *out) {
+    static const char *const flags[] = {
+        "reads-globals", "writes-globals", "reads-memory", "writes-memory",
+        "allocates", "io", "halts"
+    };
+    fprintf(out, "\n======== Effects ========\n");
+    for (int i = 0; i < summaries.size(); i++) {
+        FnSummary *s = summaries[i];
+        fprintf(out, "%-24s %-10s", s->fn->GetId()->GetIdName(),
+                Kind(s->effects));
+        for (int f = 0; f < 7; f++)
+            if (s->effects & (1 << f)) fprintf(out, " %s", flags[f]);
+        PrintNames(out, "globals", s->globals);
+        PrintNames(out, "fields", s->fields);
+        if (s->opaque) fprintf(out, " (unresolved calls)");
+        int keys = s->fn->GetMemoKeys();
+        if (keys >= 0) fprintf(out, " memoized (%s)", keys ? "hash" : "direct");
+        fprintf(out, "\n");
+    }
+    fprintf(out, "======== Effects ========\n");
+}
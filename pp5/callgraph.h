@@ -0,0 +1,116 @@
+
+
+#ifndef _H_callgraph
+#define _H_callgraph
+
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "list.h"
+#include "tac.h"
+
+class Call;
+class ClassDecl;
+class Decl;
+class FnDecl;
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class FnSummary
+{
+  public:
+    FnSummary(FnDecl *fn, ClassDecl *owner);
+
+    FnDecl *GetFn() { return fn; }
+    int GetEffects() { return effects; }
+
+    void Add(int e) { effects |= e; }
+    void ReadGlobal() { effects |= EF_ReadsGlobals; }
+    void WriteGlobal(const char *name);
+    void ReadField() { effects |= EF_ReadsMemory; }
+    void WriteField(const char *name);
+    void Instantiate(ClassDecl *c) { classes.push_back(c); }
+
+
+
+
+    void AddCall(Call *call, FnDecl *callee, Decl *receiver);
+
+  private:
+    struct Site {
+        Call *call;
+        FnDecl *callee;
+        Decl *receiver;
+        std::vector<FnSummary*> targets;
+        bool unknown;
+    };
+
+    FnDecl *fn;
+    ClassDecl *owner;
+    int effects;
+    bool opaque;
+    std::set<std::string> globals, fields;
+    std::vector<Site> sites;
+    std::vector<ClassDecl*> classes;
+
+    friend class CallGraph;
+};
+
+
+
+
+
+class CallGraph
+{
+  public:
+    CallGraph(List<Decl*> *decls);
+    ~CallGraph();
+
+    FnSummary *SummaryOf(FnDecl *fn);
+    void PrintReport(FILE *out);
+
+    
+    
+    
+    
+    
+    void FindReachable();
+
+  private:
+    std::vector<FnSummary*> summaries;
+    std::map<FnDecl*, FnSummary*> byFn;
+    std::vector<ClassDecl*> classes;
+
+    std::set<FnSummary*> reached;
+    std::set<ClassDecl*> live;
+    std::vector<std::pair<Decl*, int> > slots;
+    std::vector<FnSummary*> work;
+    bool anySlot;
+
+    void Resolve(FnSummary *s);
+    bool Propagate(FnSummary *s);
+    void Annotate(FnSummary *s);
+    bool Reaches(FnSummary *from, FnSummary *to);
+    void ChooseMemo(FnSummary *s);
+    void ReachFn(FnSummary *s);
+    void ReachClass(ClassDecl *c);
+    void ReachSlot(ClassDecl *c, Decl *receiver, int offset);
+};
+
+#endif
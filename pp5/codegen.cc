@@ -3,14 +3,37 @@
 #include "codegen.h"
 #include <string.h>
 #include "tac.h"
+#include "context.h"
 #include "mips.h"
+#include "stackmap.h"
+#include "stats.h"
+#include "tacfile.h"
+
+static Location *NewThisPtr() {
+    Location *l = new Location(fpRelative, 4, "this");
+    l->SetRefKind(HeapRef);
+    return l;
+}
 
-Location* CodeGenerator::ThisPtr = new Location(fpRelative, 4, "this");
+Location* CodeGenerator::ThisPtr = NewThisPtr();
 
-CodeGenerator::CodeGenerator() {
+CodeGenerator::CodeGenerator(int u) {
     local_loc = OffsetToFirstLocal;     
     param_loc = OffsetToFirstParam;     
     globl_loc = OffsetToFirstGlobal;    
+    unit = u;
+    nextLabelNum = 0;
+    nextTempNum = 0;
+    counted = false;
+}
+
+CodeGenerator::~CodeGenerator() {
+    std::list<Instruction*>::iterator p;
+    for (p = code.begin(); p != code.end(); ++p)
+        delete *p;
+    std::list<Location*>::iterator t;
+    for (t = temps.begin(); t != temps.end(); ++t)
+        delete *t;
 }
 
 int CodeGenerator::GetNextLocalLoc() {
@@ -32,7 +55,7 @@ int CodeGenerator::GetNextGlobalLoc() {
 }
 
 int CodeGenerator::GetFrameSize() {
-    return OffsetToFirstLocal - local_loc;
+    return OffsetToStackMap - local_loc;
 }
 
 void CodeGenerator::ResetFrameSize() {
@@ -41,20 +64,29 @@ void CodeGenerator::ResetFrameSize() {
 }
 
 char *CodeGenerator::NewLabel() {
-    static int nextLabelNum = 0;
-    char temp[10];
-    sprintf(temp, "_L%d", nextLabelNum++);
+    char temp[32];
+    sprintf(temp, "_L%d.%d", unit, nextLabelNum++);
     return strdup(temp);
 }
 
 Location *CodeGenerator::GenTempVar() {
-    static int nextTempNum;
-    char temp[10];
+    char temp[16];
     Location *result = NULL;
     sprintf(temp, "_tmp%d", nextTempNum++);
     
     result = new Location(fpRelative, GetNextLocalLoc(), temp);
     Assert(result != NULL);
+    temps.push_back(result);
+    return result;
+}
+
+Location *CodeGenerator::NewFrameTemp(BeginFunc *f) {
+    char temp[32];
+    int offset = OffsetToStackMap - f->GetFrameSize();
+    sprintf(temp, "_slot%d", -offset);
+    f->SetFrameSize(f->GetFrameSize() + VarSize);
+    Location *result = new Location(fpRelative, offset, temp);
+    temps.push_back(result);
     return result;
 }
 
@@ -65,8 +97,12 @@ Location *CodeGenerator::GenLoadConstant(int value) {
 }
 
 Location *CodeGenerator::GenLoadConstant(const char *s) {
+    return GenLoadConstant(s, strlen(s));
+}
+
+Location *CodeGenerator::GenLoadConstant(const char *s, int len) {
     Location *result = GenTempVar();
-    code.push_back(new LoadStringConstant(result, s));
+    code.push_back(new LoadStringConstant(result, s, len));
     return result;
 }
 
@@ -138,15 +174,17 @@ void CodeGenerator::GenPopParams(int numBytesOfParams) {
         code.push_back(new PopParams(numBytesOfParams));
 }
 
-Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue) {
+Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue,
+                                  int effects) {
     Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-    code.push_back(new LCall(label, result));
+    code.push_back(new LCall(label, result, effects));
     return result;
 }
 
-Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue) {
+Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue,
+                                  int effects) {
     Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-    code.push_back(new ACall(fnAddr, result));
+    code.push_back(new ACall(fnAddr, result, effects));
     return result;
 }
 
@@ -154,17 +192,25 @@ static struct _builtin {
     const char *label;
     int numArgs;
     bool hasReturn;
+    int effects;
 } builtins[] = {
-    {"_Alloc", 1, true},
-    {"_ReadLine", 0, true},
-    {"_ReadInteger", 0, true},
-    {"_StringEqual", 2, true},
-    {"_PrintInt", 1, false},
-    {"_PrintString", 1, false},
-    {"_PrintBool", 1, false},
-    {"_Halt", 0, false}
+    {"_Alloc", 2, true, EF_ReadsMemory|EF_WritesMemory|EF_Allocates|EF_Halts},
+    {"_ReadLine", 0, true,
+     EF_ReadsMemory|EF_WritesMemory|EF_Allocates|EF_IO|EF_Halts},
+    {"_ReadInteger", 0, true, EF_IO},
+    {"_StringEqual", 2, true, EF_ReadsMemory},
+    {"_PrintInt", 1, false, EF_IO},
+    {"_PrintString", 1, false, EF_IO},
+    {"_PrintBool", 1, false, EF_IO},
+    {"_Print", -1, false, EF_IO},
+    {"_Halt", 0, false, EF_IO|EF_Halts}
 };
 
+int CodeGenerator::BuiltInEffects(BuiltIn b) {
+    Assert(b >= 0 && b < NumBuiltIns);
+    return builtins[b].effects;
+}
+
 Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1,
         Location *arg2)
 {
@@ -179,31 +225,131 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1,
             || (b->numArgs == 2 && arg1 && arg2));
     if (arg2) code.push_back(new PushParam(arg2));
     if (arg1) code.push_back(new PushParam(arg1));
-    code.push_back(new LCall(b->label, result));
+    code.push_back(new LCall(b->label, result, b->effects));
     GenPopParams(VarSize*b->numArgs);
     return result;
 }
 
+void CodeGenerator::GenPrint(const char *tags, List<Location*> *args) {
+    Assert(strlen(tags) == args->NumElements());
+    for (int i = args->NumElements() - 1; i >= 0; i--)
+        GenPushParam(args->Nth(i));
+    GenPushParam(GenLoadConstant(tags));
+    code.push_back(new LCall(builtins[Print].label, NULL,
+                             builtins[Print].effects));
+    GenPopParams(VarSize*(args->NumElements() + 1));
+}
+
+Location *CodeGenerator::GenAlloc(Location *bytes, BlockKind kind) {
+    Location *total = GenBinaryOp("+", bytes, GenLoadConstant(HeaderSize));
+    return GenHeapAlloc(total, GenBinaryOp("+", total, GenLoadConstant(kind)));
+}
+
+Location *CodeGenerator::GenAlloc(int bytes, BlockKind kind) {
+    return GenHeapAlloc(GenLoadConstant(bytes + HeaderSize),
+                        GenLoadConstant(bytes + HeaderSize + kind));
+}
+
+Location *CodeGenerator::GenHeapAlloc(Location *total, Location *header) {
+    Location *result = GenTempVar();
+    result->SetRefKind(HeapRef);
+    const char *slow = NewLabel(), *done = NewLabel();
+    Location *heap = GenLoadLabel("_heap_cur");
+    Location *cur = GenLoad(heap);
+    Location *end = GenLoad(heap, VarSize);
+    Location *next = GenBinaryOp("+", cur, total);
+    GenIfZ(GenBinaryOp("<=", next, end), slow);
+    GenStore(heap, next);
+    GenStore(cur, header);
+    GenAssign(result, GenBinaryOp("+", cur, GenLoadConstant(HeaderSize)));
+    GenGoto(done);
+    GenLabel(slow);
+    GenAssign(result, GenBuiltInCall(Alloc, total, header));
+    GenLabel(done);
+    return result;
+}
+
 void CodeGenerator::GenVTable(const char *className,
-        List<const char *> *methodLabels)
+        List<const char *> *methodLabels, List<int> *refOffsets)
 {
-    code.push_back(new VTable(className, methodLabels));
+    code.push_back(new VTable(className, methodLabels, refOffsets));
+}
+
+void CodeGenerator::GenMemoTable(const char *fnLabel, int entryBytes) {
+    code.push_back(new MemoTable(fnLabel, MemoSlots, entryBytes));
+}
+
+void CodeGenerator::CountInstrs() {
+    if (!Stats::IsOn() || counted) return;
+    counted = true;
+    std::list<Instruction*>::iterator p;
+    for (p = code.begin(); p != code.end(); ++p)
+        Stats::CountInstr((*p)->GetKind());
+    Stats::Count(S_TacInstrs, code.size());
+}
+
+void CodeGenerator::PrintTac(FILE *out) {
+    CountInstrs();
+    std::list<Instruction*>::iterator p;
+    for (p= code.begin(); p != code.end(); ++p) {
+        (*p)->Print(out);
+    }
 }
 
-void CodeGenerator::DoFinalCodeGen() {
-    if (IsDebugOn("tac")) { 
-        std::list<Instruction*>::iterator p;
-        for (p= code.begin(); p != code.end(); ++p) {
-            (*p)->Print();
-        }
-    }  else {
-        Mips mips;
-        mips.EmitPreamble();
 
-        std::list<Instruction*>::iterator p;
-        for (p= code.begin(); p != code.end(); ++p) {
+
+
+
+
+static int TailCallBytes(std::list<Instruction*>::iterator p,
+                         std::list<Instruction*>::iterator end) {
+    Location *result = (*p)->GetDst();
+    int bytes = 0;
+    if (++p != end && (*p)->GetKind() == I_PopParams)
+        bytes = dynamic_cast<PopParams*>(*p++)->GetNumBytes();
+    if (p == end) return -1;
+    if ((*p)->GetKind() == I_EndFunc) return bytes;
+    if ((*p)->GetKind() != I_Return) return -1;
+    Location *value;
+    return !(*p)->GetUses(&value) || value == result ? bytes : -1;
+}
+
+void CodeGenerator::EmitMips(std::string *out) {
+    CountInstrs();
+    Mips mips(out, unit);
+    StackMaps maps(this);
+    bool tail = CompilationContext::Current()->optLevel >= 1;
+    std::list<Instruction*>::iterator p;
+    for (p= code.begin(); p != code.end(); ++p) {
+        mips.SetStackMap(maps.At(*p));
+        instrT kind = (*p)->GetKind();
+        int bytes = tail && (kind == I_LCall || kind == I_ACall)
+                  ? TailCallBytes(p, code.end()) : -1;
+        if (bytes >= 0 && mips.CanTailCall(bytes)) {
+            mips.SetTailCall(bytes);
             (*p)->Emit(&mips);
+            if ((*std::next(p))->GetKind() == I_PopParams) ++p;
+            if ((*std::next(p))->GetKind() == I_Return) ++p;
+            continue;
         }
+        (*p)->Emit(&mips);
+        if (kind == I_BeginFunc)
+            mips.EmitClearSlots(maps.EntrySlots());
     }
 }
 
+void CodeGenerator::Append(Instruction *instr) {
+    int u, n;
+    if (instr->GetKind() == I_Label
+        && sscanf(dynamic_cast<Label*>(instr)->text(), "_L%d.%d", &u, &n) == 2
+        && u == unit && n >= nextLabelNum)
+        nextLabelNum = n + 1;
+    code.push_back(instr);
+}
+
+void CodeGenerator::Save(TacWriter *w) {
+    w->BeginUnit(unit);
+    std::list<Instruction*>::iterator p;
+    for (p = code.begin(); p != code.end(); ++p)
+        (*p)->Save(w);
+}
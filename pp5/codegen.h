@@ -5,18 +5,35 @@
 
 #include <cstdlib>
 #include <list>
+#include <string>
 #include "tac.h"
 
 
 typedef enum { Alloc, ReadLine, ReadInteger, StringEqual,
-               PrintInt, PrintString, PrintBool, Halt, NumBuiltIns } BuiltIn;
+               PrintInt, PrintString, PrintBool, Print, Halt,
+               NumBuiltIns } BuiltIn;
+
+
+
+
+
+
+typedef enum { PlainBlock, ObjectBlock, RefArrayBlock } BlockKind;
 
 class CodeGenerator {
   private:
     std::list<Instruction*> code;
+    std::list<Location*> temps;
     int local_loc;
     int param_loc;
     int globl_loc;
+    int unit;
+    int nextLabelNum;
+    int nextTempNum;
+    bool counted;
+
+    void CountInstrs();
+    Location *GenHeapAlloc(Location *total, Location *header);
 
   public:
     
@@ -29,21 +46,30 @@ class CodeGenerator {
     
     
     
-    static const int OffsetToFirstLocal = -8,
+    static const int OffsetToStackMap = -8,
+                     OffsetToFirstLocal = -12,
                      OffsetToFirstParam = 4,
                      OffsetToFirstGlobal = 0;
     static const int VarSize = 4;
+    static const int HeaderSize = 12;
+    static const int MemoHeaderSize = 12, MemoSlots = 1024;
 
     
     int GetNextLocalLoc();
     int GetNextParamLoc();
     int GetNextGlobalLoc();
     int GetFrameSize();
+    int GetParamSize() { return param_loc - OffsetToFirstParam; }
     void ResetFrameSize();
 
     static Location* ThisPtr;
 
-    CodeGenerator();
+    
+    
+    
+    CodeGenerator(int unit = 0);
+    ~CodeGenerator();
+    int GetUnit() { return unit; }
 
     
     
@@ -56,6 +82,11 @@ class CodeGenerator {
     
     
     
+    Location *NewFrameTemp(BeginFunc *f);
+
+    
+    
+    
     
     
     
@@ -64,6 +95,7 @@ class CodeGenerator {
     
     Location *GenLoadConstant(int value);
     Location *GenLoadConstant(const char *str);
+    Location *GenLoadConstant(const char *str, int len);
     Location *GenLoadLabel(const char *label);
 
     
@@ -108,14 +140,17 @@ class CodeGenerator {
     
     
     
-    Location *GenLCall(const char *label, bool fnHasReturnValue);
+    
+    Location *GenLCall(const char *label, bool fnHasReturnValue,
+                       int effects = EF_All);
 
     
     
     
     
     
-    Location *GenACall(Location *fnAddr, bool fnHasReturnValue);
+    Location *GenACall(Location *fnAddr, bool fnHasReturnValue,
+                       int effects = EF_All);
 
     
     
@@ -128,6 +163,20 @@ class CodeGenerator {
     
     Location *GenBuiltInCall(BuiltIn b, Location *arg1 = NULL,
             Location *arg2 = NULL);
+    static int BuiltInEffects(BuiltIn b);
+
+    
+    
+    
+    
+    void GenPrint(const char *tags, List<Location*> *args);
+
+    
+    
+    
+    
+    Location *GenAlloc(Location *bytes, BlockKind kind);
+    Location *GenAlloc(int bytes, BlockKind kind);
 
     
     
@@ -149,16 +198,25 @@ class CodeGenerator {
     
     
     
-    void GenVTable(const char *className, List<const char*> *methodLabels);
+    void GenVTable(const char *className, List<const char*> *methodLabels,
+                   List<int> *refOffsets);
 
     
     
     
+    void GenMemoTable(const char *fnLabel, int entryBytes);
+
     
     
     
-    void DoFinalCodeGen();
+    void PrintTac(FILE *out);
+    void EmitMips(std::string *out);
+
+
+
+    void Save(TacWriter *w);
+    void Append(Instruction *instr);
+    std::list<Instruction*> *GetCode() { return &code; }
 };
 
 #endif
-
@@ -0,0 +1,80 @@
+
+
+#include "context.h"
+#include <iostream>
+#include <stdlib.h>
+#include "ast_stmt.h"
+#include "codegen.h"
+#include "parser.h"
+#include "scope.h"
+#include "stats.h"
+
+thread_local CompilationContext *CompilationContext::current = NULL;
+
+CompilationContext::CompilationContext() : numErrors(0) {
+    scanner = NULL;
+    fast = NULL;
+    lineNum = colNum = 1;
+    program = NULL;
+    scopes = NULL;
+    cg = NULL;
+    errors = NULL;
+    out = stdout;
+    jobs = 1;
+    const char *level = GetOption("O");
+    optLevel = level ? atoi(level) : 0;
+    const char *limit = GetOption("opt-bisect-limit");
+    bisectLimit = limit ? atoi(limit) : -1;
+    InheritDebugKeys(&debugKeys);
+}
+
+CompilationContext::~CompilationContext() {
+    delete scopes;
+    delete cg;
+}
+
+bool CompilationContext::Compile(int fd) {
+    Use use(this);
+    if (!source.Load(fd)) {
+        ReportError::Formatted(NULL, "Unable to read source input");
+        return false;
+    }
+    return CompileSource();
+}
+
+bool CompilationContext::Compile(const char *text, size_t len) {
+    Use use(this);
+    source.Load(text, len);
+    return CompileSource();
+}
+
+bool CompilationContext::CompileSource() {
+    InitScanner(this);
+    if (IsDebugOn("tokens") || GetOption("scan-only")) {
+        ScanAll(this);
+        FreeScanner(this);
+    } else {
+        {
+            PhaseTimer t("parse");
+            yyparse(this);
+        }
+        FreeScanner(this);
+        if (program && numErrors == 0)
+            program->Check();
+        if (program && numErrors == 0)
+            program->Emit();
+    }
+
+    fflush(out);
+    return numErrors == 0;
+}
+
+void CompilationContext::WriteErrors(const std::string &text) {
+    std::lock_guard<std::mutex> g(errorLock);
+    if (errors) {
+        errors->append(text);
+    } else {
+        fflush(out);
+        std::cerr << text;
+    }
+}
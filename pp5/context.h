@@ -0,0 +1,82 @@
+
+
+#ifndef _H_context
+#define _H_context
+
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include "list.h"
+#include "source.h"
+
+class CodeGenerator;
+class FastScanner;
+class Program;
+class scopeST;
+
+
+
+
+
+
+
+
+
+class CompilationContext
+{
+  public:
+    CompilationContext();
+    ~CompilationContext();
+
+
+    Source source;
+    void *scanner;
+    FastScanner *fast;
+    int lineNum, colNum;
+
+
+    Program *program;
+    scopeST *scopes;
+    CodeGenerator *cg;
+
+
+    std::atomic<int> numErrors;
+    std::string *errors;
+    std::mutex errorLock;
+    FILE *out;
+    List<const char*> debugKeys;
+    int jobs;
+    int optLevel, bisectLimit;
+
+
+
+
+    bool Compile(int fd);
+    bool Compile(const char *text, size_t len);
+
+
+
+    void WriteErrors(const std::string &text);
+
+    static CompilationContext *Current() { return current; }
+
+
+
+    class Use
+    {
+      public:
+        Use(CompilationContext *c) : prev(current) { current = c; }
+        ~Use() { current = prev; }
+
+      private:
+        CompilationContext *prev;
+    };
+
+  private:
+    static thread_local CompilationContext *current;
+
+    bool CompileSource();
+};
+
+#endif
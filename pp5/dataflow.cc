@@ -0,0 +1,444 @@
+
+
+#include "dataflow.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "codegen.h"
+#include "stats.h"
+
+void BitSet::Clear() {
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] = 0;
+}
+
+void BitSet::Fill() {
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] = ~(uint64_t)0;
+    if (size & 63)
+        words.back() = ((uint64_t)1 << (size & 63)) - 1;
+}
+
+int BitSet::Count() const {
+    int n = 0;
+    for (size_t i = 0; i < words.size(); i++)
+        n += __builtin_popcountll(words[i]);
+    return n;
+}
+
+int BitSet::First() const {
+    return Next(0);
+}
+
+int BitSet::Next(int i) const {
+    size_t w = i >> 6;
+    if (w >= words.size()) return -1;
+    uint64_t bits = words[w] & (~(uint64_t)0 << (i & 63));
+    while (!bits) {
+        if (++w == words.size()) return -1;
+        bits = words[w];
+    }
+    return w * 64 + __builtin_ctzll(bits);
+}
+
+
+
+
+
+
+bool BitSet::UnionWith(const BitSet &b) {
+    uint64_t *a = words.data();
+    const uint64_t *o = b.words.data();
+    uint64_t diff = 0;
+    for (size_t i = 0, n = words.size(); i < n; i++) {
+        uint64_t w = a[i] | o[i];
+        diff |= w ^ a[i];
+        a[i] = w;
+    }
+    return diff != 0;
+}
+
+bool BitSet::IntersectWith(const BitSet &b) {
+    uint64_t *a = words.data();
+    const uint64_t *o = b.words.data();
+    uint64_t diff = 0;
+    for (size_t i = 0, n = words.size(); i < n; i++) {
+        uint64_t w = a[i] & o[i];
+        diff |= w ^ a[i];
+        a[i] = w;
+    }
+    return diff != 0;
+}
+
+void BitSet::Subtract(const BitSet &b) {
+    uint64_t *a = words.data();
+    const uint64_t *o = b.words.data();
+    for (size_t i = 0, n = words.size(); i < n; i++)
+        a[i] &= ~o[i];
+}
+
+bool BitSet::SetToTransfer(const BitSet &gen, const BitSet &in,
+                           const BitSet &kill) {
+    uint64_t *a = words.data();
+    const uint64_t *g = gen.words.data(), *x = in.words.data(),
+                   *k = kill.words.data();
+    uint64_t diff = 0;
+    for (size_t i = 0, n = words.size(); i < n; i++) {
+        uint64_t w = g[i] | (x[i] & ~k[i]);
+        diff |= w ^ a[i];
+        a[i] = w;
+    }
+    return diff != 0;
+}
+
+static int64_t Key(Location *l) {
+    return (int64_t)l->GetSegment() << 32 | (uint32_t)l->GetOffset();
+}
+
+int FlowGraph::Number(Location *l) {
+    auto it = locationIndex.find(Key(l));
+    if (it != locationIndex.end()) return it->second;
+    locations.push_back(l);
+    return locationIndex[Key(l)] = locations.size() - 1;
+}
+
+int FlowGraph::IndexOf(Location *l) const {
+    auto it = locationIndex.find(Key(l));
+    return it == locationIndex.end() ? -1 : it->second;
+}
+
+static const char *BranchTarget(Instruction *instr) {
+    if (instr->GetKind() == I_Goto)
+        return dynamic_cast<Goto*>(instr)->branch_label();
+    if (instr->GetKind() == I_IfZ)
+        return dynamic_cast<IfZ*>(instr)->branch_label();
+    return NULL;
+}
+
+FlowGraph::FlowGraph(CodeGenerator *cg) {
+    PhaseTimer t("cfg");
+    std::list<Instruction*> *code = cg->GetCode();
+    std::unordered_map<std::string, int> labels;
+    bool startBlock = true;
+    for (auto p = code->begin(); p != code->end(); ++p) {
+        Instruction *instr = *p;
+        instrT kind = instr->GetKind();
+        if (kind == I_MemoTable) continue;
+        if (kind == I_Label && !blocks.empty() && !blocks.back().instrs.empty())
+            startBlock = true;
+        if (startBlock) {
+            blocks.push_back(BasicBlock());
+            startBlock = false;
+        }
+        if (kind == I_Label)
+            labels[dynamic_cast<Label*>(instr)->text()] = blocks.size() - 1;
+
+        FlowInstr fi;
+        fi.pos = p;
+        fi.instr = instr;
+        Location *dst = instr->GetDst();
+        fi.def = dst ? Number(dst) : -1;
+        Location *uses[Instruction::MaxUses];
+        fi.numUses = instr->GetUses(uses);
+        for (int i = 0; i < fi.numUses; i++)
+            fi.uses[i] = Number(uses[i]);
+        fi.call = kind == I_LCall || kind == I_ACall;
+        fi.effects = instr->GetEffects();
+        fi.exit = kind == I_Return || kind == I_EndFunc;
+        fi.halt = kind == I_LCall
+            && !strcmp(dynamic_cast<LCall*>(instr)->GetLabel(), "_Halt");
+        blocks.back().instrs.push_back(fi);
+
+        if (kind == I_Goto || kind == I_IfZ || kind == I_Return
+            || kind == I_EndFunc || fi.halt)
+            startBlock = true;
+    }
+
+    for (int b = 0; b < blocks.size(); b++) {
+        Instruction *last = blocks[b].instrs.back().instr;
+        instrT kind = last->GetKind();
+        bool halts = blocks[b].instrs.back().halt;
+        if (const char *target = BranchTarget(last)) {
+            auto it = labels.find(target);
+            if (it != labels.end()) blocks[b].succs.push_back(it->second);
+        }
+        if (kind != I_Goto && kind != I_Return && kind != I_EndFunc && !halts
+            && b + 1 < blocks.size()
+            && (blocks[b].succs.empty() || blocks[b].succs[0] != b + 1))
+            blocks[b].succs.push_back(b + 1);
+        for (int i = 0; i < blocks[b].succs.size(); i++)
+            blocks[blocks[b].succs[i]].preds.push_back(b);
+    }
+
+    globals = BitSet(locations.size());
+    for (int i = 0; i < locations.size(); i++)
+        if (locations[i]->GetSegment() == gpRelative) globals.Set(i);
+    ComputeOrder();
+}
+
+
+
+
+void FlowGraph::ComputeOrder() {
+    int n = blocks.size();
+    std::vector<bool> seen(n, false);
+    std::vector<std::pair<int, int> > stack;
+    order.clear();
+    if (n > 0) {
+        stack.push_back(std::make_pair(0, 0));
+        seen[0] = true;
+    }
+    while (!stack.empty()) {
+        int b = stack.back().first;
+        int &next = stack.back().second;
+        if (next < blocks[b].succs.size()) {
+            int s = blocks[b].succs[next++];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack.push_back(std::make_pair(s, 0));
+            }
+        } else {
+            order.push_back(b);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    for (int b = 0; b < n; b++)
+        if (!seen[b]) order.push_back(b);
+}
+
+void Liveness::Step(const FlowInstr &fi, const BitSet &globals,
+                    BitSet *live) {
+    if (fi.def >= 0) live->Reset(fi.def);
+    for (int i = 0; i < fi.numUses; i++)
+        live->Set(fi.uses[i]);
+    if ((fi.effects & EF_ReadsGlobals) || fi.exit) live->UnionWith(globals);
+}
+
+Liveness::Liveness(FlowGraph *g) {
+    PhaseTimer t("liveness");
+    int n = g->NumBlocks();
+    width = g->NumLocations();
+    boundary = BitSet(width);
+    gen.assign(n, BitSet(width));
+    kill.assign(n, BitSet(width));
+    for (int b = 0; b < n; b++) {
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        for (int i = instrs.size() - 1; i >= 0; i--) {
+            Step(instrs[i], g->Globals(), &gen[b]);
+            if (instrs[i].def >= 0) kill[b].Set(instrs[i].def);
+        }
+    }
+    visits = Solve(g, this);
+}
+
+ReachingDefs::ReachingDefs(FlowGraph *g) : graph(g) {
+    PhaseTimer t("reaching-defs");
+    int n = g->NumBlocks(), numLocs = g->NumLocations();
+    for (int l = 0; l < numLocs; l++) {
+        defInstr.push_back(NULL);
+        defLocation.push_back(l);
+        if (g->Globals().Test(l)) globalList.push_back(l);
+    }
+    firstDef.resize(n);
+    for (int b = 0; b < n; b++) {
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        firstDef[b].resize(instrs.size());
+        for (int i = 0; i < instrs.size(); i++) {
+            firstDef[b][i] = defInstr.size();
+            if (instrs[i].def >= 0) {
+                defInstr.push_back(instrs[i].instr);
+                defLocation.push_back(instrs[i].def);
+            }
+            if (instrs[i].effects & EF_WritesGlobals) {
+                for (int k = 0; k < globalList.size(); k++) {
+                    defInstr.push_back(instrs[i].instr);
+                    defLocation.push_back(globalList[k]);
+                }
+            }
+        }
+    }
+
+    width = defInstr.size();
+    defsOf.assign(numLocs, BitSet(width));
+    defList.resize(numLocs);
+    for (int d = 0; d < width; d++) {
+        defsOf[defLocation[d]].Set(d);
+        defList[defLocation[d]].push_back(d);
+    }
+
+    boundary = BitSet(width);
+    for (int l = 0; l < numLocs; l++)
+        boundary.Set(l);
+    gen.assign(n, BitSet(width));
+    kill.assign(n, BitSet(width));
+    for (int b = 0; b < n; b++) {
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        for (int i = 0; i < instrs.size(); i++) {
+            Step(b, i, &gen[b]);
+            if (instrs[i].def >= 0) kill[b].UnionWith(defsOf[instrs[i].def]);
+        }
+    }
+    visits = Solve(g, this);
+}
+
+void ReachingDefs::Step(int b, int i, BitSet *reaching) const {
+    const FlowInstr &fi = graph->Block(b).instrs[i];
+    int d = firstDef[b][i];
+    if (fi.def >= 0) {
+        reaching->Subtract(defsOf[fi.def]);
+        reaching->Set(d++);
+    }
+    if (fi.effects & EF_WritesGlobals)
+        for (int k = 0; k < globalList.size(); k++)
+            reaching->Set(d++);
+}
+
+int ReachingDefs::DefAt(int b, int i) const {
+    return graph->Block(b).instrs[i].def >= 0 ? firstDef[b][i] : -1;
+}
+
+
+
+int ReachingDefs::UniqueDef(int loc, const BitSet &reaching) const {
+    const std::vector<int> &defs = defList[loc];
+    int found = -1;
+    for (int k = 0; k < defs.size(); k++) {
+        if (!reaching.Test(defs[k])) continue;
+        if (found >= 0) return -1;
+        found = defs[k];
+    }
+    return found;
+}
+
+
+
+
+Dominators::Dominators(FlowGraph *g) {
+    PhaseTimer t("dominators");
+    int n = g->NumBlocks();
+    const std::vector<int> &order = g->Order();
+    std::vector<int> position(n);
+    for (int k = 0; k < n; k++) position[order[k]] = k;
+
+    idom.assign(n, -1);
+    children.resize(n);
+    if (n == 0) return;
+    idom[0] = 0;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int k = 1; k < n; k++) {
+            int b = order[k];
+            const std::vector<int> &preds = g->Block(b).preds;
+            int best = -1;
+            for (int i = 0; i < preds.size(); i++) {
+                int p = preds[i];
+                if (idom[p] < 0) continue;
+                if (best < 0) {
+                    best = p;
+                    continue;
+                }
+                int x = p, y = best;
+                while (x != y) {
+                    while (position[x] > position[y]) x = idom[x];
+                    while (position[y] > position[x]) y = idom[y];
+                }
+                best = x;
+            }
+            if (best >= 0 && idom[b] != best) {
+                idom[b] = best;
+                changed = true;
+            }
+        }
+    }
+    for (int b = 1; b < n; b++)
+        if (idom[b] >= 0) children[idom[b]].push_back(b);
+}
+
+bool Dominators::Dominates(int a, int b) const {
+    if (idom[b] < 0) return false;
+    while (b != a && b != 0) b = idom[b];
+    return b == a;
+}
+
+
+
+
+
+Loops::Loops(FlowGraph *g, const Dominators &dom) {
+    PhaseTimer t("loops");
+    int n = g->NumBlocks();
+    std::vector<int> index(n, -1);
+    const std::vector<int> &order = g->Order();
+    for (int k = 0; k < n; k++) {
+        int b = order[k];
+        if (!dom.Reachable(b)) continue;
+        const std::vector<int> &succs = g->Block(b).succs;
+        for (int i = 0; i < succs.size(); i++) {
+            int h = succs[i];
+            if (!dom.Dominates(h, b)) continue;
+            if (index[h] < 0) {
+                index[h] = loops.size();
+                loops.push_back(Loop());
+                loops.back().header = h;
+                loops.back().blocks = BitSet(n);
+                loops.back().blocks.Set(h);
+            }
+            Loop &l = loops[index[h]];
+            l.latches.push_back(b);
+            std::vector<int> work(1, b);
+            while (!work.empty()) {
+                int x = work.back();
+                work.pop_back();
+                if (l.blocks.Test(x)) continue;
+                l.blocks.Set(x);
+                const std::vector<int> &preds = g->Block(x).preds;
+                for (int j = 0; j < preds.size(); j++)
+                    if (dom.Reachable(preds[j])) work.push_back(preds[j]);
+            }
+        }
+    }
+
+    for (int i = 0; i < loops.size(); i++) {
+        Loop &l = loops[i];
+        for (int b = l.blocks.First(); b >= 0; b = l.blocks.Next(b + 1)) {
+            const std::vector<int> &succs = g->Block(b).succs;
+            for (int j = 0; j < succs.size(); j++)
+                if (!l.blocks.Test(succs[j]))
+                    l.exits.push_back(std::make_pair(b, succs[j]));
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(),
+                     [](const Loop &a, const Loop &b) {
+                         return a.blocks.Count() < b.blocks.Count();
+                     });
+}
+
+bool Loops::Contains(int outer, int inner) const {
+    return outer != inner && loops[outer].blocks.Test(loops[inner].header);
+}
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void ReportDataflow(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    const char *name = (!code->empty() && code->front()->GetKind() == I_Label)
+                     ? dynamic_cast<Label*>(code->front())->text() : "?";
+    double t0 = Now();
+    FlowGraph g(cg);
+    double t1 = Now();
+    Liveness live(&g);
+    double t2 = Now();
+    ReachingDefs reach(&g);
+    double t3 = Now();
+    fprintf(stderr, "dataflow: %s: %zu instrs, %d blocks, %d locations, "
+            "%d defs; cfg %.3f ms, liveness %d visits %.3f ms, "
+            "reaching-defs %d visits %.3f ms\n", name, code->size(),
+            g.NumBlocks(), g.NumLocations(), reach.NumDefs(), t1 - t0,
+            live.Visits(), t2 - t1, reach.Visits(), t3 - t2);
+}
@@ -0,0 +1,301 @@
+
+
+#ifndef _H_dataflow
+#define _H_dataflow
+
+#include <algorithm>
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tac.h"
+
+class CodeGenerator;
+
+
+
+
+
+
+
+
+class BitSet
+{
+  public:
+    BitSet(int n = 0) : size(n), words((n + 63) / 64, 0) {}
+
+    int Size() const { return size; }
+    bool Test(int i) const { return words[i >> 6] >> (i & 63) & 1; }
+    void Set(int i) { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+    void Reset(int i) { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+    void Clear();
+    void Fill();
+    int Count() const;
+    int First() const;
+    int Next(int i) const;
+
+
+
+    bool UnionWith(const BitSet &b);
+    bool IntersectWith(const BitSet &b);
+    void Subtract(const BitSet &b);
+
+
+    bool SetToTransfer(const BitSet &gen, const BitSet &in,
+                       const BitSet &kill);
+
+    bool operator==(const BitSet &b) const { return words == b.words; }
+
+  private:
+    int size;
+    std::vector<uint64_t> words;
+};
+
+
+
+
+
+struct FlowInstr {
+    std::list<Instruction*>::iterator pos;
+    Instruction *instr;
+    int def;
+    int uses[Instruction::MaxUses], numUses;
+    bool call, exit, halt;
+    int effects;
+};
+
+struct BasicBlock {
+    std::vector<FlowInstr> instrs;
+    std::vector<int> succs, preds;
+};
+
+
+
+
+
+
+
+
+
+
+class FlowGraph
+{
+  public:
+    FlowGraph(CodeGenerator *cg);
+
+    int NumBlocks() const { return blocks.size(); }
+    BasicBlock &Block(int i) { return blocks[i]; }
+    const std::vector<int> &Order() const { return order; }
+
+    int NumLocations() const { return locations.size(); }
+    Location *LocationAt(int i) const { return locations[i]; }
+    int IndexOf(Location *l) const;
+    const BitSet &Globals() const { return globals; }
+
+  private:
+    std::vector<BasicBlock> blocks;
+    std::vector<int> order;
+    std::vector<Location*> locations;
+    std::unordered_map<int64_t, int> locationIndex;
+    BitSet globals;
+
+    int Number(Location *l);
+    void ComputeOrder();
+};
+
+class Dominators
+{
+  public:
+    Dominators(FlowGraph *g);
+
+    int IDom(int b) const { return idom[b]; }
+    bool Reachable(int b) const { return idom[b] >= 0; }
+    bool Dominates(int a, int b) const;
+    const std::vector<int> &Children(int b) const { return children[b]; }
+
+  private:
+    std::vector<int> idom;
+    std::vector<std::vector<int> > children;
+};
+
+
+
+
+
+struct Loop {
+    int header;
+    BitSet blocks;
+    std::vector<int> latches;
+    std::vector<std::pair<int, int> > exits;
+};
+
+class Loops
+{
+  public:
+    Loops(FlowGraph *g, const Dominators &dom);
+
+    int NumLoops() const { return loops.size(); }
+    const Loop &At(int i) const { return loops[i]; }
+    bool Contains(int outer, int inner) const;
+
+  private:
+    std::vector<Loop> loops;
+};
+
+typedef enum { Forward, Backward } Direction;
+typedef enum { Union, Intersection } Meet;
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+template <class Problem>
+int Solve(FlowGraph *g, Problem *p) {
+    int n = g->NumBlocks();
+    bool forward = Problem::direction == Forward;
+    BitSet init(p->Width());
+    if (Problem::meet == Intersection) init.Fill();
+    p->in.assign(n, init);
+    p->out.assign(n, init);
+
+    std::vector<int> order = g->Order();
+    if (!forward) std::reverse(order.begin(), order.end());
+    std::vector<int> position(n);
+    for (int k = 0; k < n; k++) position[order[k]] = k;
+
+    BitSet pending(n);
+    pending.Fill();
+    int visits = 0;
+    for (int k = pending.First(); k >= 0; k = pending.First()) {
+        pending.Reset(k);
+        visits++;
+        int b = order[k];
+        BasicBlock &block = g->Block(b);
+        const std::vector<int> &from = forward ? block.preds : block.succs;
+        const std::vector<int> &to = forward ? block.succs : block.preds;
+        BitSet &meet = forward ? p->in[b] : p->out[b];
+        BitSet &result = forward ? p->out[b] : p->in[b];
+
+        if (from.empty() || (forward && b == 0)) meet = p->Boundary();
+        else meet = forward ? p->out[from[0]] : p->in[from[0]];
+        for (int i = (from.empty() || (forward && b == 0)) ? 0 : 1;
+             i < from.size(); i++) {
+            const BitSet &s = forward ? p->out[from[i]] : p->in[from[i]];
+            if (Problem::meet == Union) meet.UnionWith(s);
+            else meet.IntersectWith(s);
+        }
+
+        if (p->Transfer(b, meet, &result))
+            for (int i = 0; i < to.size(); i++)
+                pending.Set(position[to[i]]);
+    }
+    return visits;
+}
+
+
+
+
+class GenKillProblem
+{
+  public:
+    std::vector<BitSet> in, out;
+
+    int Width() const { return width; }
+    const BitSet &Boundary() const { return boundary; }
+    bool Transfer(int b, const BitSet &meet, BitSet *result) {
+        return result->SetToTransfer(gen[b], meet, kill[b]);
+    }
+
+  protected:
+    int width;
+    std::vector<BitSet> gen, kill;
+    BitSet boundary;
+};
+
+
+
+
+
+
+
+class Liveness: public GenKillProblem
+{
+  public:
+    static const Direction direction = Backward;
+    static const Meet meet = Union;
+
+    Liveness(FlowGraph *g);
+
+    const BitSet &LiveIn(int b) const { return in[b]; }
+    const BitSet &LiveOut(int b) const { return out[b]; }
+    int Visits() const { return visits; }
+
+
+
+    static void Step(const FlowInstr &fi, const BitSet &globals,
+                     BitSet *live);
+
+  private:
+    int visits;
+};
+
+
+
+
+
+
+
+
+
+
+class ReachingDefs: public GenKillProblem
+{
+  public:
+    static const Direction direction = Forward;
+    static const Meet meet = Union;
+
+    ReachingDefs(FlowGraph *g);
+
+    int NumDefs() const { return defInstr.size(); }
+    Instruction *DefInstr(int d) const { return defInstr[d]; }
+    int DefLocation(int d) const { return defLocation[d]; }
+    const BitSet &DefsOf(int loc) const { return defsOf[loc]; }
+    int DefAt(int b, int i) const;
+    int UniqueDef(int loc, const BitSet &reaching) const;
+    const std::vector<int> &DefList(int loc) const { return defList[loc]; }
+    const BitSet &ReachIn(int b) const { return in[b]; }
+    const BitSet &ReachOut(int b) const { return out[b]; }
+    int Visits() const { return visits; }
+
+
+
+    void Step(int b, int i, BitSet *reaching) const;
+
+  private:
+    FlowGraph *graph;
+    std::vector<Instruction*> defInstr;
+    std::vector<int> defLocation;
+    std::vector<BitSet> defsOf;
+    std::vector<std::vector<int> > defList;
+    std::vector<std::vector<int> > firstDef;
+    std::vector<int> globalList;
+    int visits;
+};
+
+
+
+void ReportDataflow(CodeGenerator *cg);
+
+#endif
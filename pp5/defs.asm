@@ -1,11 +1,46 @@
+# Console output goes through a buffer: the print builtins append to
+# _out_buf and _OutFlush writes it with a single syscall when it fills,
+# at a line break once it is half full, before any input is read, on
+# _Halt and as main returns.
+_Print:
+        subu    $sp, $sp, 16
+        sw      $fp, 16($sp)
+        sw      $ra, 12($sp)
+        sw      $s0, 8($sp)
+        sw      $s1, 4($sp)
+        addiu   $fp, $sp, 16
+        lw      $s0, 4($fp)     # one tag character per argument
+        addiu   $s1, $fp, 8     # the arguments follow the tag string
+ploop:  lb      $t0, 0($s0)
+        beqz    $t0, pdone
+        lw      $a0, 0($s1)
+        addiu   $s0, $s0, 1
+        addiu   $s1, $s1, 4
+        li      $t1, 105        # 'i'
+        beq     $t0, $t1, pint
+        li      $t1, 115        # 's'
+        beq     $t0, $t1, pstr
+        jal     _OutBool
+        b       ploop
+pint:   jal     _OutInt
+        b       ploop
+pstr:   jal     _OutString
+        b       ploop
+pdone:  lw      $s1, -12($fp)
+        lw      $s0, -8($fp)
+        move    $sp, $fp
+        lw      $ra, -4($fp)
+        lw      $fp, 0($fp)
+        jr      $ra
+
+
 _PrintInt:
         subu    $sp, $sp, 8
         sw      $fp, 8($sp)
         sw      $ra, 4($sp)
         addiu   $fp, $sp, 8
-        li      $v0, 1
         lw      $a0, 4($fp)
-        syscall
+        jal     _OutInt
         move    $sp, $fp
         lw      $ra, -4($fp)
         lw      $fp, 0($fp)
@@ -17,9 +52,8 @@ _PrintString:
         sw      $fp, 8($sp)
         sw      $ra, 4($sp)
         addiu   $fp, $sp, 8
-        li      $v0, 4
         lw      $a0, 4($fp)
-        syscall
+        jal     _OutString
         move    $sp, $fp
         lw      $ra, -4($fp)
         lw      $fp, 0($fp)
@@ -31,37 +65,534 @@ _PrintBool:
         sw      $fp, 8($sp)
         sw      $ra, 4($sp)
         addiu   $fp, $sp, 8
-        lw      $t1, 4($fp)
-        blez    $t1, fbr
-        li      $v0, 4          # system call for print_str
-        la      $a0, TRUE       # address of str to print
-        syscall
-        b end
-
-fbr:    li      $v0, 4          # system call for print_str
-        la      $a0, FALSE      # address of str to print
-        syscall
-
-end:    move    $sp, $fp
+        lw      $a0, 4($fp)
+        jal     _OutBool
+        move    $sp, $fp
         lw      $ra, -4($fp)
         lw      $fp, 0($fp)
         jr      $ra
 
 
+# The _Out routines below are leaves that take their argument in $a0
+# and may clobber $t0-$t9, $a0, $a1 and $v0.
+_OutBool:
+        move    $t0, $a0
+        la      $a0, TRUE
+        li      $a1, 4
+        bgtz    $t0, _OutStr
+        la      $a0, FALSE
+        li      $a1, 5
+        j       _OutStr
+
+
+_OutString:
+        lw      $a1, -4($a0)    # strings carry their length
+        j       _OutStr
+
+
+# Digits are produced from the negated value so that the most negative
+# integer needs no special case.
+_OutInt:
+        la      $t3, _out_num
+        addiu   $t3, $t3, 12
+        move    $t5, $t3
+        move    $t4, $a0
+        blez    $t4, oineg
+        subu    $t4, $zero, $t4
+oineg:  li      $t6, 10
+oidig:  rem     $t1, $t4, $t6
+        div     $t4, $t4, $t6
+        li      $t2, 48         # '0'
+        subu    $t2, $t2, $t1
+        addiu   $t3, $t3, -1
+        sb      $t2, 0($t3)
+        bnez    $t4, oidig
+        bgez    $a0, oiout
+        li      $t2, 45         # '-'
+        addiu   $t3, $t3, -1
+        sb      $t2, 0($t3)
+oiout:  move    $a0, $t3
+        subu    $a1, $t5, $t3
+        j       _OutStr
+
+
+# Appends the $a1 bytes at $a0 to the buffer. A string too long for the
+# buffer is written directly after flushing what is already there.
+_OutStr:
+        move    $t9, $ra
+        la      $t0, _out_len
+        lw      $t1, 0($t0)
+        addu    $t2, $t1, $a1
+        li      $t3, 1023       # room for the terminating NUL
+        ble     $t2, $t3, ocopy
+        move    $t8, $a0
+        jal     _OutFlush
+        move    $a0, $t8
+        li      $t1, 0
+        li      $t3, 1023
+        ble     $a1, $t3, ocopy
+        li      $v0, 4
+        syscall
+        jr      $t9
+
+ocopy:  la      $t3, _out_buf
+        addu    $t3, $t3, $t1
+        addu    $t1, $t1, $a1
+        la      $t0, _out_len
+        sw      $t1, 0($t0)
+oloop:  beqz    $a1, odone
+        lb      $t4, 0($a0)
+        sb      $t4, 0($t3)
+        addiu   $a0, $a0, 1
+        addiu   $t3, $t3, 1
+        addiu   $a1, $a1, -1
+        b       oloop
+
+odone:  li      $t2, 512        # flush at a line break once half full
+        blt     $t1, $t2, oret
+        lb      $t4, -1($t3)
+        li      $t2, 10
+        bne     $t4, $t2, oret
+        jal     _OutFlush
+oret:   jr      $t9
+
+
+# Writes out and empties the buffer; clobbers $t0, $t1, $a0 and $v0.
+_OutFlush:
+        la      $t0, _out_len
+        lw      $t1, 0($t0)
+        beqz    $t1, ofret
+        sw      $zero, 0($t0)
+        la      $a0, _out_buf
+        addu    $t1, $a0, $t1
+        sb      $zero, 0($t1)
+        li      $v0, 4
+        syscall
+ofret:  jr      $ra
+
+
+# Every heap block starts with three words: the header (block size in
+# bytes, with the low two bits giving the kind: 0 holds no references,
+# 1 is an object whose vtable lists its reference fields, 2 is an array
+# of references), the mark/forwarding word, and the length of an array
+# or string (unused for objects). References point just past them.
+#
+# Compiled code bumps _heap_cur inline and only calls _Alloc when the
+# current chunk [_heap_cur, _heap_end) is too small for the request.
+# _Alloc(bytes, header) takes the block size including the header.
 _Alloc:
         subu    $sp, $sp, 8
         sw      $fp, 8($sp)
         sw      $ra, 4($sp)
         addiu   $fp, $sp, 8
-        li      $v0, 9
         lw      $a0, 4($fp)
-        syscall
+        lw      $a1, 8($fp)
+        jal     _HeapAlloc
         move    $sp, $fp
         lw      $ra, -4($fp)
         lw      $fp, 0($fp)
         jr      $ra
 
 
+# Allocates a block of $a0 bytes (a whole number of words, header
+# included) with header word $a1 and returns the reference in $v0.
+# Must be called from a runtime routine with its own frame, so that
+# 0($fp) is the compiled frame the collector starts walking from.
+_HeapAlloc:
+        la      $t0, _heap_cur
+        lw      $v0, 0($t0)
+        lw      $t1, 4($t0)
+        addu    $t2, $v0, $a0
+        bgt     $t2, $t1, hslow
+hbump:  sw      $t2, 0($t0)     # bump the cursor
+        sw      $a1, 0($v0)     # and write the header
+        addiu   $v0, $v0, 12
+        jr      $ra
+
+hslow:  subu    $sp, $sp, 12
+        sw      $ra, 8($sp)
+        sw      $a0, 4($sp)
+        sw      $a1, 0($sp)
+        la      $t3, _heap_start
+        lw      $t3, 0($t3)
+        beqz    $t3, hgrow      # no heap yet
+        subu    $t4, $v0, $t3
+        addu    $t4, $t4, $a0   # heap in use after this request
+        la      $t5, _gc_limit
+        lw      $t5, 0($t5)
+        ble     $t4, $t5, hgrow
+        jal     _GC
+        lw      $a0, 4($sp)
+        lw      $a1, 0($sp)
+        la      $t0, _heap_cur
+        lw      $v0, 0($t0)
+        lw      $t1, 4($t0)
+        addu    $t2, $v0, $a0
+        ble     $t2, $t1, hfit
+
+hgrow:  li      $t3, 65536      # grow the heap a chunk at a time
+        bge     $t3, $a0, hsbrk
+        move    $t3, $a0        # or by the whole request if it is bigger
+hsbrk:  move    $a0, $t3
+        li      $v0, 9          # syscall "sbrk" for memory allocation
+        syscall
+        lw      $a0, 4($sp)
+        la      $t0, _heap_cur
+        addu    $t1, $v0, $t3
+        la      $t5, _heap_start
+        lw      $t6, 0($t5)
+        bnez    $t6, hcont
+        sw      $v0, 0($t5)     # the first chunk starts the heap
+        sw      $v0, 0($t0)
+        b       hjoin
+hcont:  lw      $t2, 4($t0)
+        beq     $v0, $t2, hjoin # new memory extends the current chunk
+        sw      $v0, 0($t0)     # otherwise start over in the new chunk,
+        li      $t5, 0x7fffffff # which leaves a hole the collector
+        la      $t6, _gc_limit  # cannot walk, so stop collecting
+        sw      $t5, 0($t6)
+hjoin:  sw      $t1, 4($t0)
+        lw      $v0, 0($t0)
+        addu    $t2, $v0, $a0
+hfit:   lw      $a1, 0($sp)
+        lw      $ra, 8($sp)
+        addiu   $sp, $sp, 12
+        b       hbump
+
+
+# Mark-compact collection of [_heap_start, _heap_cur). The roots are the
+# globals listed in _gc_globals and, in every frame from the caller of
+# the runtime routine up to main, the slots named by the stack map the
+# compiled code stored at -8($fp) before the call. A map is a count of
+# reference slots, their fp offsets, then the same for derived pointers
+# (addresses inside a block, such as array elements).
+#
+# $s0 heap start, $s1 heap end, $s2 first compiled frame, $s3 bottom of
+# the mark stack (kept on $sp), $s4 work done, $s5 0 while marking and
+# 1 while updating references, $s6 main's frame, $s7 return address of
+# gcroots, $a3 the new end of the heap.
+_GC:
+        subu    $sp, $sp, 36
+        sw      $ra, 32($sp)
+        sw      $s0, 28($sp)
+        sw      $s1, 24($sp)
+        sw      $s2, 20($sp)
+        sw      $s3, 16($sp)
+        sw      $s4, 12($sp)
+        sw      $s5, 8($sp)
+        sw      $s6, 4($sp)
+        sw      $s7, 0($sp)
+        la      $t0, _heap_start
+        lw      $s0, 0($t0)
+        la      $t0, _heap_cur
+        lw      $s1, 0($t0)
+        lw      $s2, 0($fp)
+        la      $t0, _gc_base
+        lw      $s6, 0($t0)
+        li      $s4, 0
+
+        # mark everything reachable from the roots
+        move    $s3, $sp
+        li      $s5, 0
+        jal     gcroots
+mloop:  beq     $sp, $s3, mdone
+        lw      $t0, 0($sp)
+        addiu   $sp, $sp, 4
+        lw      $t1, -12($t0)
+        andi    $t2, $t1, 3
+        jal     gcfields
+        b       mloop
+
+        # give each marked block its address after compaction
+mdone:  move    $t0, $s0
+        move    $a3, $s0
+floop:  bge     $t0, $s1, fdone
+        lw      $t1, 0($t0)
+        srl     $t3, $t1, 2
+        sll     $t3, $t3, 2
+        addiu   $s4, $s4, 1
+        lw      $t4, 4($t0)
+        beqz    $t4, fnext
+        addiu   $t5, $a3, 12
+        sw      $t5, 4($t0)
+        addu    $a3, $a3, $t3
+fnext:  addu    $t0, $t0, $t3
+        b       floop
+
+        # point the roots and the fields of live blocks at the new places
+fdone:  li      $s5, 1
+        jal     gcroots
+        move    $t0, $s0
+uloop:  bge     $t0, $s1, udone
+        lw      $t1, 0($t0)
+        srl     $t3, $t1, 2
+        sll     $t3, $t3, 2
+        addu    $t9, $t0, $t3
+        lw      $t4, 4($t0)
+        beqz    $t4, unext
+        andi    $t2, $t1, 3
+        addiu   $t0, $t0, 12
+        jal     gcfields
+unext:  move    $t0, $t9
+        b       uloop
+
+        # slide the live blocks down and clear their marks
+udone:  move    $t0, $s0
+vloop:  bge     $t0, $s1, vdone
+        lw      $t1, 0($t0)
+        srl     $t3, $t1, 2
+        sll     $t3, $t3, 2
+        addu    $t9, $t0, $t3
+        lw      $t4, 4($t0)
+        beqz    $t4, vnext
+        addiu   $t5, $t4, -12
+        move    $t6, $t5
+cloop:  bge     $t0, $t9, cdone
+        lw      $t7, 0($t0)
+        sw      $t7, 0($t6)
+        addiu   $t0, $t0, 4
+        addiu   $t6, $t6, 4
+        addiu   $s4, $s4, 1
+        b       cloop
+cdone:  sw      $zero, 4($t5)
+vnext:  move    $t0, $t9
+        b       vloop
+
+        # the space left behind must read as zero for the next objects
+vdone:  move    $t0, $a3
+zloop:  bge     $t0, $s1, zdone
+        sw      $zero, 0($t0)
+        addiu   $t0, $t0, 4
+        b       zloop
+zdone:  la      $t0, _heap_cur
+        sw      $a3, 0($t0)
+        la      $t0, _gc_count
+        lw      $t1, 0($t0)
+        addiu   $t1, $t1, 1
+        sw      $t1, 0($t0)
+        lw      $t1, 4($t0)     # _gc_reclaimed
+        subu    $t2, $s1, $a3
+        addu    $t1, $t1, $t2
+        sw      $t1, 4($t0)
+        lw      $t1, 8($t0)     # _gc_work
+        addu    $t1, $t1, $s4
+        sw      $t1, 8($t0)
+        subu    $t1, $a3, $s0   # collect again once the heap is twice
+        sll     $t1, $t1, 1     # what survived this time
+        la      $t0, _gc_limit
+        lw      $t2, 0($t0)
+        bge     $t2, $t1, gcdone
+        sw      $t1, 0($t0)
+gcdone: lw      $ra, 32($sp)
+        lw      $s0, 28($sp)
+        lw      $s1, 24($sp)
+        lw      $s2, 20($sp)
+        lw      $s3, 16($sp)
+        lw      $s4, 12($sp)
+        lw      $s5, 8($sp)
+        lw      $s6, 4($sp)
+        lw      $s7, 0($sp)
+        addiu   $sp, $sp, 36
+        jr      $ra
+
+
+# Applies gcslot to every reference field of the block whose reference
+# is in $t0 and whose kind is in $t2. Uses $t3-$t5 and $t8.
+gcfields:
+        move    $t8, $ra
+        beq     $t2, 1, gcobj
+        bne     $t2, 2, gcfret
+        lw      $t4, -4($t0)    # array length
+        move    $t5, $t0
+gcaloop:
+        beqz    $t4, gcfret
+        move    $a0, $t5
+        jal     gcslot
+        addiu   $t5, $t5, 4
+        addiu   $t4, $t4, -1
+        b       gcaloop
+gcobj:  lw      $t3, 0($t0)     # vtable
+        beqz    $t3, gcfret
+        lw      $t4, -4($t3)    # number of reference fields
+        addiu   $t3, $t3, -8
+gcoloop:
+        beqz    $t4, gcfret
+        lw      $t5, 0($t3)
+        addu    $a0, $t0, $t5
+        jal     gcslot
+        addiu   $t3, $t3, -4
+        addiu   $t4, $t4, -1
+        b       gcoloop
+gcfret: jr      $t8
+
+
+# Applies gcslot to each global reference and each slot in the stack
+# maps, and gcderived to each derived pointer. Uses $t3-$t6.
+gcroots:
+        move    $s7, $ra
+        la      $t3, _gc_globals
+        lw      $t4, 0($t3)
+grloop: beqz    $t4, grframes
+        addiu   $t3, $t3, 4
+        lw      $t5, 0($t3)
+        addu    $a0, $gp, $t5
+        jal     gcslot
+        addiu   $t4, $t4, -1
+        b       grloop
+grframes:
+        move    $t6, $s2
+grframe:
+        beqz    $t6, grdone
+        lw      $t3, -8($t6)    # stack map
+        lw      $t4, 0($t3)
+grref:  beqz    $t4, grderiv
+        addiu   $t3, $t3, 4
+        lw      $t5, 0($t3)
+        addu    $a0, $t6, $t5
+        jal     gcslot
+        addiu   $t4, $t4, -1
+        b       grref
+grderiv:
+        addiu   $t3, $t3, 4
+        lw      $t4, 0($t3)
+grdloop:
+        beqz    $t4, grnext
+        addiu   $t3, $t3, 4
+        lw      $t5, 0($t3)
+        addu    $a0, $t6, $t5
+        jal     gcderived
+        addiu   $t4, $t4, -1
+        b       grdloop
+grnext: beq     $t6, $s6, grdone
+        lw      $t6, 0($t6)
+        b       grframe
+grdone: jr      $s7
+
+
+# The slot at $a0 holds a reference or null. While marking, mark its
+# block and push it; while updating, replace it with the new address.
+# Uses $v0 and $v1 only.
+gcslot: lw      $v0, 0($a0)
+        addiu   $s4, $s4, 1
+        addiu   $v1, $s0, 12
+        blt     $v0, $v1, gcsret
+        bge     $v0, $s1, gcsret
+        bnez    $s5, gcsupd
+        lw      $v1, -8($v0)
+        bnez    $v1, gcsret
+        li      $v1, 1
+        sw      $v1, -8($v0)
+        subu    $sp, $sp, 4
+        sw      $v0, 0($sp)
+        jr      $ra
+gcsupd: lw      $v0, -8($v0)
+        sw      $v0, 0($a0)
+gcsret: jr      $ra
+
+
+# The slot at $a0 holds an address inside some block; find the block by
+# walking the heap, then mark it or move the address along with it.
+# Uses $v0, $v1, $a1 and $a2.
+gcderived:
+        lw      $v0, 0($a0)
+        blt     $v0, $s0, gcdret
+        bge     $v0, $s1, gcdret
+        move    $v1, $s0
+gcdfind:
+        lw      $a1, 0($v1)
+        srl     $a1, $a1, 2
+        sll     $a1, $a1, 2
+        addu    $a1, $v1, $a1
+        addiu   $s4, $s4, 1
+        blt     $v0, $a1, gcdfound
+        move    $v1, $a1
+        b       gcdfind
+gcdfound:
+        addiu   $v1, $v1, 12    # the block's reference
+        bnez    $s5, gcdupd
+        lw      $a1, -8($v1)
+        bnez    $a1, gcdret
+        li      $a1, 1
+        sw      $a1, -8($v1)
+        subu    $sp, $sp, 4
+        sw      $v1, 0($sp)
+        jr      $ra
+gcdupd: lw      $a2, -8($v1)
+        subu    $v0, $v0, $v1
+        addu    $v0, $a2, $v0
+        sw      $v0, 0($a0)
+gcdret: jr      $ra
+
+
+# Called as main returns; flushes the output buffer and prints the
+# collector statistics when the program was compiled with -d gcstats.
+# Pause time is reported as the number of heap words the collector
+# visited, since SPIM has no clock. With -d memostats the compiler also
+# lists its memo tables in _memo_stats, and each one's hit and miss
+# counters are printed here.
+_Exit:
+        move    $t9, $ra
+        jal     _OutFlush
+        move    $ra, $t9
+        la      $t0, _gc_verbose
+        lw      $t0, 0($t0)
+        beqz    $t0, mxstart
+        la      $t0, _gc_count
+        li      $v0, 4
+        la      $a0, GCSTAT1
+        syscall
+        li      $v0, 1
+        lw      $a0, 0($t0)
+        syscall
+        li      $v0, 4
+        la      $a0, GCSTAT2
+        syscall
+        li      $v0, 1
+        lw      $a0, 4($t0)
+        syscall
+        li      $v0, 4
+        la      $a0, GCSTAT3
+        syscall
+        li      $v0, 1
+        lw      $a0, 8($t0)
+        syscall
+        li      $v0, 4
+        la      $a0, GCSTAT4
+        syscall
+mxstart:
+        la      $t0, _memo_stats
+        lw      $t1, 0($t0)     # number of tables listed
+        beqz    $t1, gxret
+        li      $v0, 4
+        la      $a0, MEMOSTAT0
+        syscall
+mxloop: beqz    $t1, gxret
+        addiu   $t0, $t0, 4
+        lw      $t2, 0($t0)     # table: hits, misses, name
+        li      $v0, 4
+        la      $a0, MEMOSTAT1
+        syscall
+        lw      $a0, 8($t2)
+        syscall
+        la      $a0, MEMOSTAT2
+        syscall
+        li      $v0, 1
+        lw      $a0, 0($t2)
+        syscall
+        li      $v0, 4
+        la      $a0, MEMOSTAT3
+        syscall
+        li      $v0, 1
+        lw      $a0, 4($t2)
+        syscall
+        li      $v0, 4
+        la      $a0, MEMOSTAT4
+        syscall
+        addiu   $t1, $t1, -1
+        b       mxloop
+gxret:  jr      $ra
+
+
 _StringEqual:
         subu    $sp, $sp, 8     # decrement sp to make space to save ra, fp
         sw      $fp, 8($sp)     # save fp
@@ -69,41 +600,37 @@ _StringEqual:
         addiu   $fp, $sp, 8     # set up new fp
         subu    $sp, $sp, 4     # decrement sp to make space for locals/temps
 
-        li      $v0, 0
-
-        #Determine length string 1
+        # Strings are word aligned and carry their length in the word
+        # just before the first character, like arrays do.
         lw      $t0, 4($fp)
-        li      $t3, 0
-
-bloop1: lb      $t5, ($t0)
-        beqz    $t5, eloop1
-        addi    $t0, 1
-        addi    $t3, 1
-        b       bloop1
-
-eloop1: # Determine length string 2
         lw      $t1, 8($fp)
-        li      $t4, 0
+        li      $v0, 1
+        beq     $t0, $t1, end1  # same string (interned literals)
+        li      $v0, 0
 
-bloop2: lb      $t5, ($t1)
-        beqz    $t5, eloop2
-        addi    $t1, 1
-        addi    $t4, 1
-        b       bloop2
+        lw      $t3, -4($t0)
+        lw      $t4, -4($t1)
+        bne     $t3, $t4, end1  # Check String Lengths Same
 
-eloop2: bne     $t3,$t4,end1    # Check String Lengths Same
+        srl     $t2, $t3, 2     # compare a word at a time
+wloop3: beqz    $t2, wend3
+        lw      $t5, ($t0)
+        lw      $t6, ($t1)
+        bne     $t5, $t6, end1
+        addi    $t0, 4
+        addi    $t1, 4
+        addi    $t2, -1
+        b       wloop3
 
-        lw      $t0, 4($fp)
-        lw      $t1, 8($fp)
-        li      $t3, 0
+wend3:  andi    $t3, $t3, 3     # then the last length % 4 bytes
 
-bloop3: lb      $t5, ($t0)
+bloop3: beqz    $t3, eloop3
+        lb      $t5, ($t0)
         lb      $t6, ($t1)
         bne     $t5, $t6, end1
-        beqz    $t5, eloop3     # if zero, then we hit the end of both strings
-        addi    $t3, 1
         addi    $t0, 1
         addi    $t1, 1
+        addi    $t3, -1
         b       bloop3
 
 eloop3: li      $v0, 1
@@ -115,6 +642,7 @@ end1:   move    $sp, $fp        # pop callee frame off stack
 
 
 _Halt:
+        jal     _OutFlush
         li      $v0, 10
         syscall
 
@@ -125,6 +653,7 @@ _ReadInteger:
         sw      $ra, 4($sp)     # save ra
         addiu   $fp, $sp, 8     # set up new fp
         subu    $sp, $sp, 4     # decrement sp to make space for locals/temps
+        jal     _OutFlush       # show pending output before reading
         li      $v0, 5
         syscall
         move    $sp, $fp        # pop callee frame off stack
@@ -139,15 +668,16 @@ _ReadLine:
         sw      $ra, 4($sp)     # save ra
         addiu   $fp, $sp, 8     # set up new fp
         subu    $sp, $sp, 4     # decrement sp to make space for locals/temps
+        jal     _OutFlush       # show pending output before reading
 
         # allocate space to store memory
-        li      $a0, 128        # request 128 bytes
-        li      $v0, 9          # syscall "sbrk" for memory allocation
-        syscall                 # do the system call
+        li      $a0, 140        # request 128 bytes plus the block header
+        li      $a1, 140        # a block without references
+        jal     _HeapAlloc
 
         # read in the new line
         li      $a1, 128        # size of the buffer
-        move    $a0, $v0        # location of the buffer
+        move    $a0, $v0        # location of the buffer, after the length
         li      $v0, 8
         syscall
 
@@ -158,10 +688,14 @@ bloop4: lb      $t5, ($t1)
         addi    $t1, 1
         b       bloop4
 
-eloop4: addi    $t1, -1         # add '\0' at the end.
+eloop4: beq     $t1, $a0, len4  # nothing read, nothing to strip
+        addi    $t1, -1         # add '\0' at the end.
         li      $t6, 0
         sb      $t6, ($t1)
 
+len4:   subu    $t2, $t1, $a0   # store the length before the buffer
+        sw      $t2, -4($a0)
+
         move    $v0, $a0        # save buffer location to v0 as return value  
         move    $sp, $fp        # pop callee frame off stack
         lw      $ra, -4($fp)    # restore saved ra
@@ -170,6 +704,28 @@ eloop4: addi    $t1, -1         # add '\0' at the end.
 
 
 .data
+.align 2
+_heap_cur: .word 0
+_heap_end: .word 0
+_heap_start: .word 0
+_gc_limit: .word 262144
+_gc_base: .word 0
+_gc_count: .word 0
+_gc_reclaimed: .word 0
+_gc_work: .word 0
+_gc_nomap: .word 0, 0
+_out_len: .word 0
+_out_num: .space 12
+_out_buf: .space 1024
+GCSTAT1:.asciiz "\nGC: "
+GCSTAT2:.asciiz " collections, "
+GCSTAT3:.asciiz " bytes reclaimed, "
+GCSTAT4:.asciiz " heap words visited\n"
+MEMOSTAT0:.asciiz "\n"
+MEMOSTAT1:.asciiz "memo "
+MEMOSTAT2:.asciiz ": "
+MEMOSTAT3:.asciiz " hits, "
+MEMOSTAT4:.asciiz " misses\n"
 TRUE:.asciiz "true"
 FALSE:.asciiz "false"
 SPACE:.asciiz "Making Space For Inputed Values Is Fun."
@@ -0,0 +1,320 @@
+
+
+#include "driver.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <set>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "context.h"
+#include "threadpool.h"
+
+extern char **environ;
+
+typedef enum { Unchecked, Passed, Failed } verdictT;
+
+struct Job {
+    const char *input;
+    std::string output;
+    std::string errors;
+    std::string actual;
+    off_t size;
+    bool ok;
+    verdictT verdict;
+};
+
+
+
+struct Batch {
+    const char *outDir;
+    const char *runCommand;
+    std::string defs;
+    int timeout;
+};
+
+static std::string BaseName(const char *input) {
+    std::string name(input);
+    name = name.substr(0, name.size() - strlen(".decaf"));
+    return name;
+}
+
+static std::string OutputName(const char *input, const Batch *batch) {
+    std::string base = BaseName(input);
+    if (!batch || !batch->outDir) return base + ".asm";
+
+    size_t slash = base.rfind('/');
+    if (slash != std::string::npos) base = base.substr(slash + 1);
+    return std::string(batch->outDir) + "/" + base + ".asm";
+}
+
+static bool ReadFile(const char *name, std::string *text) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return false;
+    char buf[8192];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof buf)) > 0)
+        text->append(buf, n);
+    close(fd);
+    return n == 0;
+}
+
+static void CompileOne(Job *job, const Batch *batch) {
+    CompilationContext ctx;
+    ctx.errors = &job->errors;
+    ctx.jobs = 1;
+    job->ok = false;
+
+    int fd = open(job->input, O_RDONLY);
+    job->output = OutputName(job->input, batch);
+    FILE *out = fd < 0 ? NULL : fopen(job->output.c_str(), "w");
+    if (!out) {
+        CompilationContext::Use use(&ctx);
+        ReportError::Formatted(NULL, "Unable to %s '%s'",
+                               fd < 0 ? "read" : "write",
+                               fd < 0 ? job->input : job->output.c_str());
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    ctx.out = out;
+    job->ok = ctx.Compile(fd);
+    close(fd);
+    if (job->ok && batch && batch->runCommand)
+        fwrite(batch->defs.data(), 1, batch->defs.size(), out);
+    fclose(out);
+    if (!job->ok) unlink(job->output.c_str());
+}
+
+
+
+
+
+static void Execute(Job *job, const Batch *batch) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) < 0) {
+        job->actual = "*** Unable to create pipe\n";
+        return;
+    }
+
+    std::string input = BaseName(job->input) + ".in";
+    if (access(input.c_str(), R_OK) != 0) input = "/dev/null";
+    std::string command = std::string("exec ") + batch->runCommand
+                        + " \"$1\"";
+    const char *argv[] = { "sh", "-c", command.c_str(), "sh",
+                           job->output.c_str(), NULL };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, input.c_str(), O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], 2);
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", &actions, NULL,
+                          (char **)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipefd[1]);
+    if (err != 0) {
+        close(pipefd[0]);
+        job->actual = "*** Unable to run '" + command + "'\n";
+        return;
+    }
+
+    auto deadline = std::chrono::steady_clock::now()
+                  + std::chrono::seconds(batch->timeout);
+    bool timedOut = false;
+    char buf[8192];
+    for (;;) {
+        int left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd p = { pipefd[0], POLLIN, 0 };
+        if (left <= 0 || poll(&p, 1, left) == 0) {
+            timedOut = true;
+            kill(pid, SIGKILL);
+            break;
+        }
+        ssize_t n = read(pipefd[0], buf, sizeof buf);
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++)
+            if (buf[i] != '\0') job->actual += buf[i];
+    }
+    close(pipefd[0]);
+    waitpid(pid, NULL, 0);
+    if (timedOut) job->actual += "\n*** Timed out\n";
+}
+
+static void RunOne(Job *job, const Batch *batch) {
+    CompileOne(job, batch);
+    if (!batch->runCommand) return;
+
+    if (job->ok)
+        Execute(job, batch);
+    else
+        job->actual = job->errors;
+
+    std::string expected;
+    if (!ReadFile((BaseName(job->input) + ".out").c_str(), &expected))
+        job->verdict = Unchecked;
+    else if (expected == job->actual)
+        job->verdict = Passed;
+    else
+        job->verdict = Failed;
+}
+
+
+
+
+
+static void RunJobs(std::vector<Job> &jobs, const Batch *batch) {
+    std::vector<int> order(jobs.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+    if (batch)
+        std::stable_sort(order.begin(), order.end(), [&jobs](int a, int b) {
+            return jobs[a].size < jobs[b].size;
+        });
+
+    int workers = GetOption("jobs") ? ThreadPool::NumJobs()
+                                    : std::thread::hardware_concurrency();
+    ThreadPool pool(workers > 0 ? workers : 1);
+    for (int k = 0; k < order.size(); k++) {
+        Job *job = &jobs[order[k]];
+        if (batch)
+            pool.Submit([job, batch] { RunOne(job, batch); });
+        else
+            pool.Submit([job] { CompileOne(job, NULL); });
+    }
+    pool.WaitAll();
+}
+
+bool CompileFiles(List<const char*> *files) {
+    int n = files->NumElements();
+    std::vector<Job> jobs(n);
+    for (int i = 0; i < n; i++)
+        jobs[i].input = files->Nth(i);
+    RunJobs(jobs, NULL);
+
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        if (!jobs[i].errors.empty())
+            std::cerr << "==> " << jobs[i].input << " <==" << jobs[i].errors;
+        ok = ok && jobs[i].ok;
+    }
+    return ok;
+}
+
+
+
+static void ReadFileList(const char *listName, List<const char*> *files) {
+    FILE *f = strcmp(listName, "-") ? fopen(listName, "r") : stdin;
+    if (!f) {
+        std::cerr << "Unable to read file list '" << listName << "'\n";
+        exit(2);
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) > 0) {
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if (len > 0) files->Append(strdup(line));
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+}
+
+bool RunBatch(List<const char*> *files) {
+    const char *listName = GetOption("batch");
+    if (listName && *listName) ReadFileList(listName, files);
+
+    Batch batch;
+    batch.outDir = GetOption("out-dir");
+    batch.runCommand = GetOption("run");
+    if (batch.runCommand && !*batch.runCommand)
+        batch.runCommand = "spim -file";
+    const char *timeout = GetOption("timeout");
+    batch.timeout = timeout ? atoi(timeout) : 60;
+    if (batch.timeout <= 0) batch.timeout = 60;
+    if (batch.outDir) mkdir(batch.outDir, 0777);
+    if (batch.runCommand) {
+        const char *defs = GetOption("defs") ? GetOption("defs") : "defs.asm";
+        if (!ReadFile(defs, &batch.defs)) {
+            std::cerr << "Unable to read runtime definitions '" << defs
+                      << "'\n";
+            return false;
+        }
+    }
+
+    int n = files->NumElements();
+    if (batch.outDir) {
+        std::set<std::string> names;
+        for (int i = 0; i < n; i++)
+            if (!names.insert(OutputName(files->Nth(i), &batch)).second) {
+                std::cerr << "Two inputs would both write "
+                          << OutputName(files->Nth(i), &batch) << "\n";
+                return false;
+            }
+    }
+
+    std::vector<Job> jobs(n);
+    long bytes = 0;
+    for (int i = 0; i < n; i++) {
+        struct stat st;
+        jobs[i].input = files->Nth(i);
+        jobs[i].size = stat(jobs[i].input, &st) == 0 ? st.st_size : 0;
+        jobs[i].verdict = Unchecked;
+        bytes += jobs[i].size;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RunJobs(jobs, &batch);
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start).count();
+
+    int compiled = 0, passed = 0, failed = 0, unchecked = 0;
+    for (int i = 0; i < n; i++) {
+        Job &job = jobs[i];
+        if (job.ok) compiled++;
+        if (!batch.runCommand) {
+            if (!job.errors.empty())
+                std::cerr << "==> " << job.input << " <==" << job.errors;
+            continue;
+        }
+        if (job.verdict == Passed) {
+            passed++;
+        } else if (job.verdict == Unchecked) {
+            unchecked++;
+        } else {
+            failed++;
+            std::string actualName = OutputName(job.input, &batch);
+            actualName.replace(actualName.size() - 4, 4, ".actual");
+            FILE *f = fopen(actualName.c_str(), "w");
+            if (f) {
+                fwrite(job.actual.data(), 1, job.actual.size(), f);
+                fclose(f);
+            }
+            std::cerr << "FAIL " << job.input << " (output in "
+                      << actualName << ")\n";
+        }
+    }
+
+    fprintf(stderr, "batch: %d files, %.1f KB in %.2f s "
+            "(%.1f files/s, %.2f MB/s); %d compiled, %d with errors",
+            n, bytes / 1024.0, secs, secs > 0 ? n / secs : 0.0,
+            secs > 0 ? bytes / secs / (1024 * 1024) : 0.0,
+            compiled, n - compiled);
+    if (batch.runCommand)
+        fprintf(stderr, "; %d passed, %d failed, %d unchecked",
+                passed, failed, unchecked);
+    fprintf(stderr, "\n");
+
+    return batch.runCommand ? failed == 0 : compiled == n;
+}
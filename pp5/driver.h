@@ -0,0 +1,31 @@
+
+
+#ifndef _H_driver
+#define _H_driver
+
+#include "list.h"
+
+
+
+
+
+
+
+
+
+bool CompileFiles(List<const char*> *files);
+
+
+
+
+
+
+
+
+
+
+
+
+bool RunBatch(List<const char*> *files);
+
+#endif
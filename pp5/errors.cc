@@ -12,26 +12,38 @@ using namespace std;
 #include "ast_expr.h"
 #include "ast_stmt.h"
 #include "ast_decl.h"
+#include "context.h"
 
-int ReportError::numErrors = 0;
+thread_local string *ReportError::buffer = NULL;
 
-void ReportError::UnderlineErrorInLine(const char *line, yyltype *pos) {
+int ReportError::NumErrors() {
+    return CompilationContext::Current()->numErrors;
+}
+
+void ReportError::UnderlineErrorInLine(ostream &out, const char *line,
+        yyltype *pos) {
     if (!line) return;
-    cerr << line << endl;
+    out << line << endl;
     for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
+        out << (i >= pos->first_column ? '^' : ' ');
+    out << endl;
 }
 
 void ReportError::OutputError(yyltype *loc, string msg) {
-    numErrors++;
-    fflush(stdout); 
+    CompilationContext *ctx = CompilationContext::Current();
+    ctx->numErrors++;
+    stringstream s;
     if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
-        UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
+        s << endl << "*** Error line " << loc->first_line << "." << endl;
+        UnderlineErrorInLine(s, GetLineNumbered(loc->first_line), loc);
     } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+        s << endl << "*** Error." << endl;
+    s << "*** " << msg << endl << endl;
+
+    if (buffer)
+        buffer->append(s.str());
+    else
+        ctx->WriteErrors(s.str());
 }
 
 void ReportError::Formatted(yyltype *loc, const char *format, ...) {
@@ -39,7 +51,7 @@ void ReportError::Formatted(yyltype *loc, const char *format, ...) {
     char errbuf[2048];
 
     va_start(args, format);
-    vsprintf(errbuf,format, args);
+    vsnprintf(errbuf, sizeof(errbuf), format, args);
     va_end(args);
     OutputError(loc, errbuf);
 }
@@ -189,7 +201,7 @@ void ReportError::NoMainFound() {
 }
 
 
-void yyerror(const char *msg) {
-    ReportError::Formatted(&yylloc, "%s", msg);
+void yyerror(yyltype *loc, CompilationContext *ctx, const char *msg) {
+    ReportError::Formatted(loc, "%s", msg);
 }
 
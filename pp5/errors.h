@@ -3,6 +3,8 @@
 #ifndef _H_errors
 #define _H_errors
 
+#include <atomic>
+#include <ostream>
 #include <string>
 using std::string;
 #include "location.h"
@@ -83,13 +85,18 @@ class ReportError
     static void Formatted(yyltype *loc, const char *format, ...);
 
     
-    static int NumErrors() { return numErrors; }
+    static int NumErrors();
+
+    
+    
+    static void SetBuffer(string *buf) { buffer = buf; }
 
   private:
 
-    static void UnderlineErrorInLine(const char *line, yyltype *pos);
+    static void UnderlineErrorInLine(std::ostream &out, const char *line,
+            yyltype *pos);
     static void OutputError(yyltype *loc, string msg);
-    static int numErrors;
+    static thread_local string *buffer;
 
 };
 
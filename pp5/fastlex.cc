@@ -0,0 +1,334 @@
+
+
+#include "fastlex.h"
+#include <ctype.h>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "errors.h"
+#include "parser.h"
+#include "utility.h"
+
+#define TAB_SIZE 8
+
+
+
+enum { C_Alpha = 1, C_Digit = 2, C_Hex = 4, C_Oper = 8 };
+static unsigned char charClass[256];
+
+static inline bool Is(char c, int cls) {
+    return charClass[(unsigned char)c] & cls;
+}
+
+
+
+struct Keyword {
+    const char *word;
+    int token;
+};
+
+static const Keyword keywords[] = {
+    {"void", T_Void}, {"int", T_Int}, {"double", T_Double},
+    {"bool", T_Bool}, {"string", T_String}, {"null", T_Null},
+    {"class", T_Class}, {"extends", T_Extends}, {"this", T_This},
+    {"interface", T_Interface}, {"implements", T_Implements},
+    {"while", T_While}, {"for", T_For}, {"if", T_If}, {"else", T_Else},
+    {"return", T_Return}, {"break", T_Break}, {"New", T_New},
+    {"NewArray", T_NewArray}, {"Print", T_Print},
+    {"ReadInteger", T_ReadInteger}, {"ReadLine", T_ReadLine},
+    {"switch", T_Switch}, {"case", T_Case}, {"default", T_Default},
+    {"true", T_BoolConstant}, {"false", T_BoolConstant},
+};
+static const int NumKeywords = sizeof(keywords) / sizeof(keywords[0]);
+static const int MaxKeywordLen = 11;
+static const int HashSize = 64;
+static const Keyword *keywordTable[HashSize];
+
+static inline int KeywordHash(const char *s, int len) {
+    return ((unsigned char)s[0] * 5 + (unsigned char)s[len-1] * 25 + len)
+           & (HashSize - 1);
+}
+
+static const Keyword *LookupKeyword(const char *s, int len) {
+    if (len > MaxKeywordLen) return NULL;
+    const Keyword *k = keywordTable[KeywordHash(s, len)];
+    if (k && !strncmp(k->word, s, len) && k->word[len] == '\0') return k;
+    return NULL;
+}
+
+static void InitTables() {
+    for (int c = 0; c < 256; c++) {
+        if (isalpha(c)) charClass[c] |= C_Alpha;
+        if (isdigit(c)) charClass[c] |= C_Digit;
+        if (isxdigit(c)) charClass[c] |= C_Hex;
+        if (c && strchr("-+/*%=.,:;!<>()[]{}", c)) charClass[c] |= C_Oper;
+    }
+    for (int i = 0; i < NumKeywords; i++) {
+        const char *w = keywords[i].word;
+        int h = KeywordHash(w, strlen(w));
+        Assert(keywordTable[h] == NULL);
+        keywordTable[h] = &keywords[i];
+    }
+}
+
+
+
+
+inline const char *FastScanner::SkipSpaces(const char *p) {
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, space));
+        if (m != 0xFFFF) return p + __builtin_ctz(~m);
+    }
+#endif
+    while (p < end && *p == ' ') p++;
+    return p;
+}
+
+inline const char *FastScanner::SkipIdentChars(const char *p) {
+#ifdef __SSE2__
+    const __m128i lowerBit = _mm_set1_epi8(0x20);
+    const __m128i beforeA = _mm_set1_epi8('a' - 1);
+    const __m128i afterZ = _mm_set1_epi8('z' + 1);
+    const __m128i before0 = _mm_set1_epi8('0' - 1);
+    const __m128i after9 = _mm_set1_epi8('9' + 1);
+    const __m128i underscore = _mm_set1_epi8('_');
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i lower = _mm_or_si128(v, lowerBit);
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA),
+                                      _mm_cmplt_epi8(lower, afterZ));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, before0),
+                                      _mm_cmplt_epi8(v, after9));
+        __m128i ok = _mm_or_si128(_mm_or_si128(alpha, digit),
+                                  _mm_cmpeq_epi8(v, underscore));
+        int m = _mm_movemask_epi8(ok);
+        if (m != 0xFFFF) return p + __builtin_ctz(~m);
+    }
+#endif
+    while (p < end && (Is(*p, C_Alpha | C_Digit) || *p == '_')) p++;
+    return p;
+}
+
+
+inline const char *FastScanner::FindEither(const char *p, char a, char b) {
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                               _mm_cmpeq_epi8(v, vb)));
+        if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && *p != a && *p != b) p++;
+    return p;
+}
+
+inline const char *FastScanner::FindAny(const char *p, char a, char b,
+                                        char c) {
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                   _mm_cmpeq_epi8(v, vb));
+        int m = _mm_movemask_epi8(_mm_or_si128(hit, _mm_cmpeq_epi8(v, vc)));
+        if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && *p != a && *p != b && *p != c) p++;
+    return p;
+}
+
+
+
+
+inline void FastScanner::Matched(int len) {
+    lloc->first_line = lloc->last_line = curLineNum;
+    lloc->first_column = curColNum;
+    lloc->last_column = curColNum + len - 1;
+    curColNum += len;
+    cur += len;
+}
+
+inline void FastScanner::Tab() {
+    Matched(1);
+    curColNum += TAB_SIZE - curColNum%TAB_SIZE + 1;
+}
+
+inline void FastScanner::Newline() {
+    Matched(1);
+    curLineNum++;
+    curColNum = 1;
+}
+
+
+
+bool FastScanner::SkipComment() {
+    Matched(2);
+    for (;;) {
+        const char *q = FindAny(cur, '*', '\n', '\t');
+        if (q > cur) {
+            curColNum += q - cur - 1;
+            cur = q - 1;
+            Matched(1);
+        }
+        if (cur == end) return false;
+        if (*cur == '\n') {
+            Newline();
+        } else if (*cur == '\t') {
+            Tab();
+        } else if (cur + 1 < end && cur[1] == '/') {
+            Matched(2);
+            return true;
+        } else {
+            Matched(1);
+        }
+    }
+}
+
+int FastScanner::ScanIdentifier() {
+    const char *start = cur;
+    int len = SkipIdentChars(cur + 1) - start;
+    Matched(len);
+
+    const Keyword *k = LookupKeyword(start, len);
+    if (k) {
+        if (k->token == T_BoolConstant) lval->boolConstant = start[0] == 't';
+        return k->token;
+    }
+    if (len > MaxIdentLen) {
+        std::string text(start, len);
+        ReportError::LongIdentifier(lloc, text.c_str());
+    }
+    lval->identifier.text = start;
+    lval->identifier.len = len > MaxIdentLen ? MaxIdentLen : len;
+    return T_Identifier;
+}
+
+
+
+int FastScanner::ScanNumber() {
+    const char *start = cur, *p = cur;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && Is(p[2], C_Hex)) {
+        for (p += 2; p < end && Is(*p, C_Hex); p++)
+            ;
+        Matched(p - start);
+        lval->integerConstant = strtol(start, NULL, 16);
+        return T_IntConstant;
+    }
+    while (p < end && Is(*p, C_Digit)) p++;
+    if (p < end && *p == '.') {
+        for (p++; p < end && Is(*p, C_Digit); p++)
+            ;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            if (q < end && (*q == '+' || *q == '-')) q++;
+            if (q < end && Is(*q, C_Digit)) {
+                while (q < end && Is(*q, C_Digit)) q++;
+                p = q;
+            }
+        }
+        Matched(p - start);
+        lval->doubleConstant = atof(start);
+        return T_DoubleConstant;
+    }
+    Matched(p - start);
+    lval->integerConstant = strtol(start, NULL, 10);
+    return T_IntConstant;
+}
+
+bool FastScanner::ScanString() {
+    const char *start = cur;
+    const char *q = FindEither(cur + 1, '"', '\n');
+    if (q < end && *q == '"') {
+        Matched(q + 1 - start);
+        lval->stringConstant.text = start;
+        lval->stringConstant.len = q + 1 - start;
+        return true;
+    }
+    Matched(q - start);
+    std::string text(start, q - start);
+    ReportError::UntermString(lloc, text.c_str());
+    return false;
+}
+
+int FastScanner::ScanOperator() {
+    char c = cur[0], d = cur[1];
+    int token = 0;
+    switch (c) {
+      case '<': if (d == '=') token = T_LessEqual; break;
+      case '>': if (d == '=') token = T_GreaterEqual; break;
+      case '=': if (d == '=') token = T_Equal; break;
+      case '!': if (d == '=') token = T_NotEqual; break;
+      case '&': if (d == '&') token = T_And; break;
+      case '|': if (d == '|') token = T_Or; break;
+      case '+': if (d == '+') token = T_Incr; break;
+      case '-': if (d == '-') token = T_Decr; break;
+      case '[': if (d == ']') token = T_Dims; break;
+    }
+    if (token && cur + 1 < end) {
+        Matched(2);
+        return token;
+    }
+    if (Is(c, C_Oper)) {
+        Matched(1);
+        return c;
+    }
+    return 0;
+}
+
+FastScanner::FastScanner(const char *buf, size_t len) {
+    PrintDebug("lex", "Initializing fast scanner");
+    static std::once_flag tablesOnce;
+    std::call_once(tablesOnce, InitTables);
+    cur = buf;
+    end = buf + len;
+    curLineNum = 1;
+    curColNum = 1;
+    lval = NULL;
+    lloc = NULL;
+}
+
+int FastScanner::Scan(YYSTYPE *v, yyltype *l) {
+    lval = v;
+    lloc = l;
+    while (cur < end) {
+        char c = *cur;
+        if (c == ' ') {
+            Matched(SkipSpaces(cur + 1) - cur);
+        } else if (c == '\n') {
+            Newline();
+        } else if (c == '\t') {
+            Tab();
+        } else if (Is(c, C_Alpha)) {
+            return ScanIdentifier();
+        } else if (Is(c, C_Digit)) {
+            return ScanNumber();
+        } else if (c == '"') {
+            if (ScanString()) return T_StringConstant;
+        } else if (c == '/' && cur + 1 < end && cur[1] == '*') {
+            if (!SkipComment()) {
+                ReportError::UntermComment();
+                return 0;
+            }
+        } else if (c == '/' && cur + 1 < end && cur[1] == '/') {
+            const char *nl = (const char *)memchr(cur, '\n', end - cur);
+            Matched((nl ? nl : end) - cur);
+        } else if (int token = ScanOperator()) {
+            return token;
+        } else {
+            Matched(1);
+            ReportError::UnrecogChar(lloc, c);
+        }
+    }
+    return 0;
+}
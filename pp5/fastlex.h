@@ -0,0 +1,44 @@
+
+
+#ifndef _H_fastlex
+#define _H_fastlex
+
+#include <stddef.h>
+#include "parser.h"
+
+
+
+
+
+
+
+class FastScanner
+{
+  public:
+    FastScanner(const char *buf, size_t len);
+
+    int Scan(YYSTYPE *lval, yyltype *lloc);
+
+  private:
+    const char *cur, *end;
+    int curLineNum, curColNum;
+    YYSTYPE *lval;
+    yyltype *lloc;
+
+    const char *SkipSpaces(const char *p);
+    const char *SkipIdentChars(const char *p);
+    const char *FindEither(const char *p, char a, char b);
+    const char *FindAny(const char *p, char a, char b, char c);
+
+    void Matched(int len);
+    void Tab();
+    void Newline();
+
+    bool SkipComment();
+    int ScanIdentifier();
+    int ScanNumber();
+    bool ScanString();
+    int ScanOperator();
+};
+
+#endif
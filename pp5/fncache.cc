@@ -0,0 +1,177 @@
+
+
+#include "fncache.h"
+#include <atomic>
+#include <ctype.h>
+#include <errno.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ast_decl.h"
+#include "codegen.h"
+#include "context.h"
+#include "utility.h"
+
+#define TAB_SIZE 8
+
+static const char Version[] = "dcc-fn 8\n";
+
+static uint64_t Fnv1a(const char *p, size_t n,
+                      uint64_t h = 14695981039346656037ULL) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+FnCache *FnCache::Open(List<Decl*> *decls) {
+    const char *dir = GetOption("cache-dir");
+    if (!dir || !*dir) return NULL;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return NULL;
+
+    std::ostringstream out;
+    for (int i = 0; i < decls->NumElements(); i++)
+        decls->Nth(i)->PrintLayout(out);
+    std::string layout = out.str();
+    int level = CompilationContext::Current()->optLevel;
+    uint64_t seed = Fnv1a((const char *)&level, sizeof level,
+                          Fnv1a(Version, sizeof Version));
+    return new FnCache(dir, Fnv1a(layout.data(), layout.size(), seed));
+}
+
+
+
+
+
+static const char *AtColumn(int line, int column) {
+    int len;
+    const char *p = CompilationContext::Current()->source.Line(line, &len);
+    if (!p) return NULL;
+    int col = 1;
+    for (int i = 0; i < len; i++) {
+        if (col == column) return p + i;
+        col++;
+        if (p[i] == '\t') col += TAB_SIZE - col%TAB_SIZE + 1;
+    }
+    return NULL;
+}
+
+
+
+
+
+static bool Joins(char c) {
+    return isalnum((unsigned char)c) || (c && strchr("_.<>=!&|+-[]", c));
+}
+
+static uint64_t HashTokens(const char *p, const char *end, uint64_t h) {
+    bool gap = false;
+    char prev = '\0';
+    while (p < end) {
+        if (isspace((unsigned char)*p)) {
+            gap = true;
+            p++;
+        } else if (*p == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') p++;
+            gap = true;
+        } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+            const char *close =
+                (const char *)memmem(p + 2, end - p - 2, "*/", 2);
+            p = close ? close + 2 : end;
+            gap = true;
+        } else {
+            const char *start = p++;
+            if (*start == '"') {
+                while (p < end && *p != '"' && *p != '\n') p++;
+                if (p < end && *p == '"') p++;
+            }
+            if (gap && Joins(prev) && Joins(*start)) h = Fnv1a(" ", 1, h);
+            h = Fnv1a(start, p - start, h);
+            prev = p[-1];
+            gap = false;
+        }
+    }
+    return h;
+}
+
+uint64_t FnCache::Key(FnDecl *fn, int unit) {
+    yyltype *span = fn->GetSourceSpan();
+    const char *begin = span ? AtColumn(span->first_line, span->first_column)
+                             : NULL;
+    const char *last = span ? AtColumn(span->last_line, span->last_column)
+                            : NULL;
+    if (!begin || !last || last < begin) return 0;
+
+    const char *label = fn->GetId()->GetIdName();
+    uint64_t h = Fnv1a((const char *)&unit, sizeof unit, layout);
+    h = Fnv1a(label, strlen(label) + 1, h);
+    h = HashTokens(begin, last + 1, h);
+    return h ? h : 1;
+}
+
+std::string FnCache::FileName(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof name, "/%016llx.fn", (unsigned long long)key);
+    return dir + name;
+}
+
+
+
+bool FnCache::Lookup(uint64_t key, bool tac, std::string *text) {
+    if (!key) return false;
+    FILE *f = fopen(FileName(key).c_str(), "r");
+    if (!f) return false;
+    std::string data;
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        data.append(buf, n);
+    fclose(f);
+
+    if (data.compare(0, sizeof Version - 1, Version) != 0) return false;
+    const char *p = data.c_str() + sizeof Version - 1;
+    const char *end = data.c_str() + data.size();
+    for (int part = 0; part < 2; part++) {
+        char *body;
+        size_t len = strtoul(p, &body, 10);
+        if (*body++ != '\n' || len > (size_t)(end - body)) return false;
+        if (part == (tac ? 0 : 1)) {
+            text->assign(body, len);
+            return true;
+        }
+        p = body + len;
+    }
+    return false;
+}
+
+void FnCache::Store(uint64_t key, const std::string &tac,
+                    const std::string &mips) {
+    static std::atomic<int> serial(0);
+    if (!key) return;
+    std::string name = FileName(key);
+    std::string tmp = name + "." + std::to_string(getpid()) + "."
+                    + std::to_string(serial++);
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) return;
+    fprintf(f, "%s%zu\n", Version, tac.size());
+    fwrite(tac.data(), 1, tac.size(), f);
+    fprintf(f, "%zu\n", mips.size());
+    fwrite(mips.data(), 1, mips.size(), f);
+    if (fclose(f) != 0 || rename(tmp.c_str(), name.c_str()) != 0)
+        unlink(tmp.c_str());
+}
+
+void FnCache::Render(CodeGenerator *cg, std::string *tac, std::string *mips) {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&text, &len);
+    cg->PrintTac(f);
+    fclose(f);
+    tac->assign(text, len);
+    free(text);
+    cg->EmitMips(mips);
+}
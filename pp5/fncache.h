@@ -0,0 +1,55 @@
+
+
+#ifndef _H_fncache
+#define _H_fncache
+
+#include <stdint.h>
+#include <string>
+#include "list.h"
+
+class CodeGenerator;
+class Decl;
+class FnDecl;
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class FnCache
+{
+  public:
+
+
+
+    static FnCache *Open(List<Decl*> *decls);
+
+    uint64_t Key(FnDecl *fn, int unit);
+
+
+
+    bool Lookup(uint64_t key, bool tac, std::string *text);
+    void Store(uint64_t key, const std::string &tac, const std::string &mips);
+
+
+
+    static void Render(CodeGenerator *cg, std::string *tac, std::string *mips);
+
+  private:
+    std::string dir;
+    uint64_t layout;
+
+    FnCache(const char *d, uint64_t l) : dir(d), layout(l) {}
+    std::string FileName(uint64_t key);
+};
+
+#endif
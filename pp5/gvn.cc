@@ -0,0 +1,316 @@
+
+
+#include "gvn.h"
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "codegen.h"
+#include "dataflow.h"
+
+typedef std::array<int, 4> Key;
+
+enum { K_Constant, K_Label, K_Load, K_Call, K_ACall, K_BinaryOp };
+
+struct Holder {
+    int loc, def;
+};
+
+struct Merged {
+    int value, epoch;
+};
+
+static bool IsCommutative(BinaryOp::OpCode code) {
+    return code == BinaryOp::Add || code == BinaryOp::Mul
+        || code == BinaryOp::Eq || code == BinaryOp::Ne
+        || code == BinaryOp::And || code == BinaryOp::Or;
+}
+
+class Numbering
+{
+  public:
+    Numbering(CodeGenerator *cg)
+      : code(cg->GetCode()), g(cg), reach(&g), dom(&g),
+        defValue(reach.NumDefs(), -1),
+        memoryOut(g.NumBlocks(), -1), epochOut(g.NumBlocks(), -1),
+        nextValue(0), nextMemory(0), epoch(0), nextEpoch(0),
+        changed(false) {}
+
+    bool Run();
+
+  private:
+    std::list<Instruction*> *code;
+    FlowGraph g;
+    ReachingDefs reach;
+    Dominators dom;
+    std::map<Key, int> table;
+    std::unordered_map<std::string, int> labels;
+    std::vector<int> defValue;
+    std::unordered_map<int, Holder> avail;
+    std::vector<std::pair<int, Holder> > undo;
+    std::unordered_map<int, Merged> merged;
+    std::vector<std::pair<int, Merged> > mergedUndo;
+    std::vector<int> memoryOut, epochOut;
+    std::vector<FlowInstr*> redundant;
+    std::vector<std::list<Instruction*>::iterator> params;
+    std::map<std::vector<int>, int> argLists;
+    int nextValue, nextMemory, epoch, nextEpoch;
+    bool changed;
+
+    int ValueOf(int loc, const BitSet &reaching);
+    int Lookup(const Key &key);
+    int CallValue(FlowInstr &fi, int target, std::vector<int> *args,
+                  int popped, int memory);
+    const Holder *Available(int value, const BitSet &reaching);
+    void MakeAvailable(int value, Holder h);
+    void Number(int b);
+};
+
+
+
+
+int Numbering::ValueOf(int loc, const BitSet &reaching) {
+    int d = reach.UniqueDef(loc, reaching);
+    if (d >= 0) {
+        if (defValue[d] < 0) defValue[d] = nextValue++;
+        return defValue[d];
+    }
+    auto it = merged.find(loc);
+    if (it != merged.end() && it->second.epoch == epoch)
+        return it->second.value;
+    Merged none = { -1, -1 };
+    mergedUndo.push_back(std::make_pair(loc, it == merged.end() ? none
+                                                                : it->second));
+    Merged m = { nextValue++, epoch };
+    merged[loc] = m;
+    return m.value;
+}
+
+int Numbering::Lookup(const Key &key) {
+    auto it = table.find(key);
+    if (it != table.end()) return it->second;
+    return table[key] = nextValue++;
+}
+
+
+
+
+int Numbering::CallValue(FlowInstr &fi, int target, std::vector<int> *args,
+                         int popped, int memory) {
+    int effects = fi.instr->GetEffects();
+    bool reusable = fi.def >= 0 && args->size() == popped
+        && !(effects & ~(EF_ReadsMemory | EF_Halts));
+    int id = argLists.insert(std::make_pair(*args, argLists.size()))
+                 .first->second;
+    args->clear();
+    if (!reusable) return -1;
+    Key key = {{ fi.instr->GetKind() == I_LCall ? K_Call : K_ACall, target, id,
+                 effects & EF_ReadsMemory ? memory : -1 }};
+    return Lookup(key);
+}
+
+const Holder *Numbering::Available(int value, const BitSet &reaching) {
+    auto it = avail.find(value);
+    if (it == avail.end()) return NULL;
+    const Holder &h = it->second;
+    return reach.UniqueDef(h.loc, reaching) == h.def ? &h : NULL;
+}
+
+void Numbering::MakeAvailable(int value, Holder h) {
+    auto it = avail.find(value);
+    Holder none = { -1, -1 };
+    undo.push_back(std::make_pair(value, it == avail.end() ? none
+                                                           : it->second));
+    avail[value] = h;
+}
+
+void Numbering::Number(int b) {
+    BasicBlock &block = g.Block(b);
+    bool inherit = b != 0 && block.preds.size() == 1
+                && block.preds[0] == dom.IDom(b);
+    int memory = inherit ? memoryOut[block.preds[0]] : nextMemory++;
+    epoch = inherit ? epochOut[block.preds[0]] : nextEpoch++;
+    BitSet reaching = reach.ReachIn(b);
+    std::vector<int> args;
+
+    for (int i = 0; i < block.instrs.size(); i++) {
+        FlowInstr &fi = block.instrs[i];
+        Instruction *instr = fi.instr;
+
+
+
+        Location *uses[Instruction::MaxUses];
+        int values[Instruction::MaxUses];
+        int n = instr->GetUses(uses);
+        bool rewrite = false;
+        for (int k = 0; k < n; k++) {
+            values[k] = ValueOf(fi.uses[k], reaching);
+            const Holder *h = Available(values[k], reaching);
+            if (h && h->loc != fi.uses[k]) {
+                uses[k] = g.LocationAt(h->loc);
+                rewrite = true;
+            }
+        }
+        if (rewrite) {
+            instr->SetUses(uses);
+            changed = true;
+        }
+
+        int value = -1;
+        bool pure = true;
+        switch (instr->GetKind()) {
+          case I_LoadConstant: {
+            Key key = {{ K_Constant,
+                         dynamic_cast<LoadConstant*>(instr)->GetValue() }};
+            value = Lookup(key);
+            break;
+          }
+          case I_LoadLabel: {
+            const char *label = dynamic_cast<LoadLabel*>(instr)->GetLabel();
+            auto it = labels.insert(std::make_pair(label, labels.size()));
+            Key key = {{ K_Label, it.first->second }};
+            value = Lookup(key);
+            break;
+          }
+          case I_Load: {
+            int offset = dynamic_cast<Load*>(instr)->GetOffset();
+            Key key = {{ K_Load, values[0], offset,
+                         offset == -4 ? -1 : memory }};
+            value = Lookup(key);
+            break;
+          }
+          case I_BinaryOp: {
+            BinaryOp::OpCode op = dynamic_cast<BinaryOp*>(instr)->GetOpCode();
+            if (IsCommutative(op) && values[0] > values[1])
+                std::swap(values[0], values[1]);
+            Key key = {{ K_BinaryOp + op, values[0], values[1] }};
+            value = Lookup(key);
+            break;
+          }
+          case I_Assign:
+            value = values[0];
+            pure = false;
+            break;
+          case I_Store: {
+            memory = nextMemory++;
+            Key key = {{ K_Load, values[0],
+                         dynamic_cast<Store*>(instr)->GetOffset(), memory }};
+            table[key] = values[1];
+            pure = false;
+            break;
+          }
+          case I_PushParam:
+            args.push_back(values[0]);
+            pure = false;
+            break;
+          case I_LCall:
+          case I_ACall: {
+            int effects = instr->GetEffects();
+            Instruction *next = i + 1 < block.instrs.size()
+                              ? block.instrs[i + 1].instr : NULL;
+            int popped = next && next->GetKind() == I_PopParams
+                ? dynamic_cast<PopParams*>(next)->GetNumBytes()
+                      / CodeGenerator::VarSize
+                : 0;
+            int target = -1;
+            if (instr->GetKind() == I_ACall) {
+                target = values[0];
+            } else {
+                const char *label = dynamic_cast<LCall*>(instr)->GetLabel();
+                target = labels.insert(std::make_pair(label, labels.size()))
+                             .first->second;
+            }
+            value = CallValue(fi, target, &args, popped, memory);
+            pure = value >= 0;
+            if (effects & EF_WritesMemory) memory = nextMemory++;
+            if (effects & EF_WritesGlobals) epoch = nextEpoch++;
+            break;
+          }
+          default:
+            pure = false;
+            break;
+        }
+
+        if (fi.def >= 0) {
+            if (value < 0) value = nextValue++;
+            const Holder *h = pure ? Available(value, reaching) : NULL;
+            if (h && fi.call && !FindCallParams(code, fi.pos, &params))
+                h = NULL;
+            if (h && h->loc == fi.def) {
+                redundant.push_back(&fi);
+            } else if (h) {
+                Instruction *copy = new Assign(instr->GetDst(),
+                                               g.LocationAt(h->loc));
+                *fi.pos = copy;
+                delete instr;
+                fi.instr = copy;
+                changed = true;
+            }
+            int d = reach.DefAt(b, i);
+            defValue[d] = value;
+            reach.Step(b, i, &reaching);
+            if (!Available(value, reaching)) {
+                Holder mine = { fi.def, d };
+                MakeAvailable(value, mine);
+            }
+        } else {
+            reach.Step(b, i, &reaching);
+        }
+    }
+    memoryOut[b] = memory;
+    epochOut[b] = epoch;
+}
+
+
+
+
+
+
+bool Numbering::Run() {
+    if (g.NumBlocks() == 0) return false;
+    std::vector<std::pair<int, int> > stack;
+    std::vector<std::pair<int, int> > marks;
+    stack.push_back(std::make_pair(0, 0));
+    marks.push_back(std::make_pair(undo.size(), mergedUndo.size()));
+    Number(0);
+    while (!stack.empty()) {
+        int b = stack.back().first;
+        int &next = stack.back().second;
+        if (next < dom.Children(b).size()) {
+            int child = dom.Children(b)[next++];
+            stack.push_back(std::make_pair(child, 0));
+            marks.push_back(std::make_pair(undo.size(), mergedUndo.size()));
+            Number(child);
+            continue;
+        }
+        for (int k = undo.size() - 1; k >= marks.back().first; k--) {
+            if (undo[k].second.loc < 0) avail.erase(undo[k].first);
+            else avail[undo[k].first] = undo[k].second;
+        }
+        for (int k = mergedUndo.size() - 1; k >= marks.back().second; k--) {
+            if (mergedUndo[k].second.epoch < 0)
+                merged.erase(mergedUndo[k].first);
+            else merged[mergedUndo[k].first] = mergedUndo[k].second;
+        }
+        undo.resize(marks.back().first);
+        mergedUndo.resize(marks.back().second);
+        marks.pop_back();
+        stack.pop_back();
+    }
+    for (int k = 0; k < redundant.size(); k++) {
+        delete redundant[k]->instr;
+        code->erase(redundant[k]->pos);
+    }
+    for (int k = 0; k < params.size(); k++) {
+        delete *params[k];
+        code->erase(params[k]);
+    }
+    return changed || !redundant.empty();
+}
+
+bool ValueNumbering::Run(CodeGenerator *cg) {
+    Numbering numbering(cg);
+    return numbering.Run();
+}
@@ -0,0 +1,33 @@
+
+
+#ifndef _H_gvn
+#define _H_gvn
+
+#include "optimizer.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class ValueNumbering: public Pass
+{
+  public:
+    const char *Name() { return "gvn"; }
+    bool Run(CodeGenerator *cg);
+};
+
+#endif
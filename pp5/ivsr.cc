@@ -0,0 +1,477 @@
+
+
+#include "ivsr.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "codegen.h"
+#include "dataflow.h"
+
+static const char *BranchTarget(Instruction *instr) {
+    if (instr->GetKind() == I_Goto)
+        return dynamic_cast<Goto*>(instr)->branch_label();
+    if (instr->GetKind() == I_IfZ)
+        return dynamic_cast<IfZ*>(instr)->branch_label();
+    return NULL;
+}
+
+static void SetBranchTarget(Instruction *instr, const char *label) {
+    if (instr->GetKind() == I_Goto)
+        dynamic_cast<Goto*>(instr)->SetBranchLabel(label);
+    else
+        dynamic_cast<IfZ*>(instr)->SetBranchLabel(label);
+}
+
+static BinaryOp *AsBinary(Instruction *instr, BinaryOp::OpCode code) {
+    BinaryOp *op = dynamic_cast<BinaryOp*>(instr);
+    return op && op->GetOpCode() == code ? op : NULL;
+}
+
+struct Induction {
+    FlowInstr *update, *add;
+    int step;
+};
+
+struct Candidate {
+    int iv, scale, base;
+    FlowInstr *mul, *add;
+};
+
+struct Test {
+    FlowInstr *compare;
+    int limit;
+};
+
+class Reducer
+{
+  public:
+    Reducer(CodeGenerator *cg, BeginFunc *begin, FlowGraph *g,
+            const ReachingDefs *reach, const Liveness *live, const Loop &l)
+      : cg(cg), begin(begin), g(g), reach(reach), live(live), loop(l) {}
+
+    bool Run();
+
+  private:
+    CodeGenerator *cg;
+    BeginFunc *begin;
+    FlowGraph *g;
+    const ReachingDefs *reach;
+    const Liveness *live;
+    const Loop &loop;
+    std::vector<int> blocks;
+    std::unordered_map<int, int> defCount, useCount;
+    std::map<int, Induction> inductions;
+    std::vector<Candidate> candidates;
+    std::map<int, Test> tests;
+    std::vector<Instruction*> preheader;
+    std::vector<FlowInstr*> dead;
+
+    bool Scan();
+    bool ConstantAt(int loc, const BitSet &reaching, int *value);
+    bool Initial(int loc, int *value);
+    bool LiveAtExit(int loc);
+    void FindInductions();
+    void FindCandidates();
+    bool CanReplaceTest(int iv, Test *test);
+    void Reduce(int iv);
+    Location *NewTemp(RefKind kind = NotRef);
+    Location *Constant(int value);
+    void Place();
+};
+
+
+
+
+
+bool Reducer::Scan() {
+    BasicBlock &header = g->Block(loop.header);
+    if (loop.header == 0 || header.instrs.empty()
+        || header.instrs[0].instr->GetKind() != I_Label)
+        return false;
+    const char *label = dynamic_cast<Label*>(header.instrs[0].instr)->text();
+    for (int k = 0; k < loop.latches.size(); k++) {
+        const char *target =
+            BranchTarget(g->Block(loop.latches[k]).instrs.back().instr);
+        if (!target || strcmp(target, label)) return false;
+    }
+
+    const std::vector<int> &order = g->Order();
+    for (int k = 0; k < order.size(); k++)
+        if (loop.blocks.Test(order[k])) blocks.push_back(order[k]);
+
+    for (int k = 0; k < blocks.size(); k++) {
+        std::vector<FlowInstr> &instrs = g->Block(blocks[k]).instrs;
+        for (int i = 0; i < instrs.size(); i++) {
+            FlowInstr &fi = instrs[i];
+            if (fi.instr->GetEffects() & EF_Allocates) return false;
+            if (fi.def >= 0) defCount[fi.def]++;
+            for (int u = 0; u < fi.numUses; u++) useCount[fi.uses[u]]++;
+        }
+    }
+    return true;
+}
+
+bool Reducer::ConstantAt(int loc, const BitSet &reaching, int *value) {
+    int d = reach->UniqueDef(loc, reaching);
+    LoadConstant *c = d >= 0
+        ? dynamic_cast<LoadConstant*>(reach->DefInstr(d)) : NULL;
+    if (c) *value = c->GetValue();
+    return c != NULL;
+}
+
+
+
+
+bool Reducer::Initial(int loc, int *value) {
+    BitSet entry(reach->NumDefs());
+    const std::vector<int> &preds = g->Block(loop.header).preds;
+    for (int k = 0; k < preds.size(); k++)
+        if (!loop.blocks.Test(preds[k]))
+            entry.UnionWith(reach->ReachOut(preds[k]));
+    int d = reach->UniqueDef(loc, entry);
+    Instruction *instr = d >= 0 ? reach->DefInstr(d) : NULL;
+    if (instr && instr->GetKind() == I_Assign) {
+        Instruction *assign = instr;
+        instr = NULL;
+        for (int b = 0; b < g->NumBlocks() && !instr; b++) {
+            std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+            BitSet reaching = reach->ReachIn(b);
+            for (int i = 0; i < instrs.size(); i++) {
+                if (instrs[i].instr == assign) {
+                    int s = reach->UniqueDef(instrs[i].uses[0], reaching);
+                    if (s < 0 || !reach->DefInstr(s)) return false;
+                    instr = reach->DefInstr(s);
+                    break;
+                }
+                reach->Step(b, i, &reaching);
+            }
+        }
+    }
+    LoadConstant *c = dynamic_cast<LoadConstant*>(instr);
+    if (c) *value = c->GetValue();
+    return c != NULL;
+}
+
+bool Reducer::LiveAtExit(int loc) {
+    for (int k = 0; k < loop.exits.size(); k++)
+        if (live->LiveIn(loop.exits[k].second).Test(loc)) return true;
+    return false;
+}
+
+
+
+
+
+
+void Reducer::FindInductions() {
+    for (int k = 0; k < blocks.size(); k++) {
+        int b = blocks[k];
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        BitSet reaching = reach->ReachIn(b);
+        for (int i = 0; i < instrs.size(); i++) {
+            FlowInstr &fi = instrs[i];
+            int v = fi.def;
+            if (v < 0 || defCount[v] != 1 || g->Globals().Test(v)) {
+                reach->Step(b, i, &reaching);
+                continue;
+            }
+            Induction ind = { &fi, NULL, 0 };
+            FlowInstr *add = &fi;
+            if (fi.instr->GetKind() == I_Assign) {
+                add = NULL;
+                for (int j = i - 1; j >= 0 && !add; j--)
+                    if (instrs[j].def == fi.uses[0]) add = &instrs[j];
+                if (!add || defCount[add->def] != 1) add = NULL;
+                ind.add = add;
+            }
+            BinaryOp *op = add ? dynamic_cast<BinaryOp*>(add->instr) : NULL;
+            BitSet at = reach->ReachIn(b);
+            for (int j = 0; add && &instrs[j] != add; j++)
+                reach->Step(b, j, &at);
+            int c;
+            if (op && op->GetOpCode() == BinaryOp::Add) {
+                if (add->uses[0] == v && ConstantAt(add->uses[1], at, &c))
+                    ind.step = c;
+                else if (add->uses[1] == v && ConstantAt(add->uses[0], at, &c))
+                    ind.step = c;
+            } else if (op && op->GetOpCode() == BinaryOp::Sub) {
+                if (add->uses[0] == v && ConstantAt(add->uses[1], at, &c))
+                    ind.step = -c;
+            }
+            if (ind.step != 0) inductions[v] = ind;
+            reach->Step(b, i, &reaching);
+        }
+    }
+}
+
+
+
+
+
+void Reducer::FindCandidates() {
+    for (int k = 0; k < blocks.size(); k++) {
+        int b = blocks[k];
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        BitSet reaching = reach->ReachIn(b);
+        for (int i = 0; i < instrs.size(); i++) {
+            FlowInstr &fi = instrs[i];
+            Candidate c = { -1, 0, -1, &fi, NULL };
+            if (AsBinary(fi.instr, BinaryOp::Mul) && defCount[fi.def] == 1) {
+                for (int u = 0; u < 2 && c.iv < 0; u++)
+                    if (inductions.count(fi.uses[u])
+                        && ConstantAt(fi.uses[1 - u], reaching, &c.scale)
+                        && c.scale > 0)
+                        c.iv = fi.uses[u];
+            }
+            reach->Step(b, i, &reaching);
+            if (c.iv < 0) continue;
+
+            int m = fi.def;
+            for (int j = i + 1; j < instrs.size(); j++) {
+                FlowInstr &next = instrs[j];
+                if (next.def == c.iv) break;
+                bool uses = false;
+                for (int u = 0; u < next.numUses; u++)
+                    uses = uses || next.uses[u] == m;
+                if (!uses) continue;
+                if (AsBinary(next.instr, BinaryOp::Add) && useCount[m] == 1
+                    && !live->LiveIn(loop.header).Test(m) && !LiveAtExit(m)) {
+                    int base = next.uses[0] == m ? next.uses[1] : next.uses[0];
+                    if (base != m && !defCount.count(base)) {
+                        c.base = base;
+                        c.add = &next;
+                    }
+                }
+                break;
+            }
+            candidates.push_back(c);
+        }
+    }
+}
+
+
+
+
+
+
+
+
+
+
+bool Reducer::CanReplaceTest(int iv, Test *test) {
+    const Induction &ind = inductions[iv];
+    int allowed = 1 + (ind.add ? 0 : 1);
+    int scale = 0;
+    for (int k = 0; k < candidates.size(); k++) {
+        if (candidates[k].iv != iv) continue;
+        allowed++;
+        if (!scale) scale = candidates[k].scale;
+        if (candidates[k].scale != scale) return false;
+    }
+    if (!scale || LiveAtExit(iv)) return false;
+    if (ind.add && (useCount[ind.add->def] != 1 || LiveAtExit(ind.add->def)))
+        return false;
+
+    test->compare = NULL;
+    for (int k = 0; k < blocks.size(); k++) {
+        int b = blocks[k];
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        BitSet reaching = reach->ReachIn(b);
+        for (int i = 0; i < instrs.size(); i++) {
+            FlowInstr &fi = instrs[i];
+            BinaryOp *op = dynamic_cast<BinaryOp*>(fi.instr);
+            if (op && (op->GetOpCode() == BinaryOp::Lt
+                       || op->GetOpCode() == BinaryOp::Le)
+                && fi.uses[0] == iv && fi.uses[1] != iv) {
+                if (test->compare
+                    || !ConstantAt(fi.uses[1], reaching, &test->limit))
+                    return false;
+                test->compare = &fi;
+                allowed++;
+            }
+            reach->Step(b, i, &reaching);
+        }
+    }
+    int init;
+    if (!test->compare || useCount[iv] != allowed || !Initial(iv, &init))
+        return false;
+
+    int64_t span = std::max(llabs(init), llabs(test->limit)) + llabs(ind.step);
+    return span * scale < (1 << 30);
+}
+
+Location *Reducer::NewTemp(RefKind kind) {
+    Location *t = cg->NewFrameTemp(begin);
+    t->SetRefKind(kind);
+    return t;
+}
+
+Location *Reducer::Constant(int value) {
+    Location *t = NewTemp();
+    preheader.push_back(new LoadConstant(t, value));
+    return t;
+}
+
+
+
+
+void Reducer::Reduce(int iv) {
+    const Induction &ind = inductions[iv];
+    Test test;
+    bool replace = CanReplaceTest(iv, &test);
+    std::map<std::pair<int, int>, Location*> families;
+    Location *first = NULL;
+    int firstBase = -1, firstScale = 0;
+    for (int k = 0; k < candidates.size(); k++) {
+        Candidate &c = candidates[k];
+        if (c.iv != iv || (!c.add && !replace)) continue;
+        Location *&var = families[std::make_pair(c.scale, c.base)];
+        if (!var) {
+            Location *base = c.base >= 0 ? g->LocationAt(c.base) : NULL;
+            var = NewTemp(base ? DerivedRef : NotRef);
+            preheader.push_back(new BinaryOp(BinaryOp::Mul, var,
+                                             g->LocationAt(iv),
+                                             Constant(c.scale)));
+            if (base)
+                preheader.push_back(new BinaryOp(BinaryOp::Add, var,
+                                                 base, var));
+            Instruction *bump = new BinaryOp(BinaryOp::Add, var, var,
+                                             Constant(c.scale * ind.step));
+            cg->GetCode()->insert(std::next(ind.update->pos), bump);
+            if (!first) {
+                first = var;
+                firstBase = c.base;
+                firstScale = c.scale;
+            }
+        }
+        FlowInstr *at = c.add ? c.add : c.mul;
+        Instruction *copy = new Assign(at->instr->GetDst(), var);
+        delete at->instr;
+        *at->pos = at->instr = copy;
+        if (c.add) dead.push_back(c.mul);
+    }
+    if (!replace || !first) return;
+
+    Location *limit = Constant(firstScale * test.limit);
+    if (firstBase >= 0) {
+        Location *bound = NewTemp(DerivedRef);
+        preheader.push_back(new BinaryOp(BinaryOp::Add, bound,
+                                         g->LocationAt(firstBase), limit));
+        limit = bound;
+    }
+    BinaryOp *compare = dynamic_cast<BinaryOp*>(test.compare->instr);
+    Instruction *replaced = new BinaryOp(compare->GetOpCode(),
+                                         compare->GetDst(), first, limit);
+    delete compare;
+    *test.compare->pos = test.compare->instr = replaced;
+    dead.push_back(ind.update);
+    if (ind.add) dead.push_back(ind.add);
+}
+
+
+
+
+
+
+void Reducer::Place() {
+    std::list<Instruction*> *code = cg->GetCode();
+    BasicBlock &header = g->Block(loop.header);
+    std::list<Instruction*>::iterator at = header.instrs[0].pos;
+    const char *label = dynamic_cast<Label*>(header.instrs[0].instr)->text();
+
+    char *entry = NULL;
+    for (int k = 0; k < header.preds.size(); k++) {
+        int p = header.preds[k];
+        if (loop.blocks.Test(p)) continue;
+        Instruction *last = g->Block(p).instrs.back().instr;
+        const char *target = BranchTarget(last);
+        if (!target || strcmp(target, label)) continue;
+        if (!entry) {
+            entry = cg->NewLabel();
+            code->insert(at, new Label(entry));
+        }
+        SetBranchTarget(last, entry);
+    }
+    free(entry);
+
+    for (int k = 0; k < preheader.size(); k++)
+        code->insert(at, preheader[k]);
+    for (int k = 0; k < dead.size(); k++) {
+        delete dead[k]->instr;
+        code->erase(dead[k]->pos);
+    }
+}
+
+bool Reducer::Run() {
+    if (!Scan()) return false;
+    FindInductions();
+    FindCandidates();
+    std::set<int> ivs;
+    for (int k = 0; k < candidates.size(); k++)
+        if (candidates[k].add) ivs.insert(candidates[k].iv);
+    Test test;
+    for (int k = 0; k < candidates.size(); k++)
+        if (!ivs.count(candidates[k].iv)
+            && CanReplaceTest(candidates[k].iv, &test))
+            ivs.insert(candidates[k].iv);
+    if (ivs.empty()) return false;
+    for (std::set<int>::iterator v = ivs.begin(); v != ivs.end(); ++v)
+        Reduce(*v);
+    Place();
+    return true;
+}
+
+
+
+
+
+
+
+
+bool StrengthReduction::Run(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    BeginFunc *begin = NULL;
+    for (auto p = code->begin(); p != code->end() && !begin; ++p)
+        begin = dynamic_cast<BeginFunc*>(*p);
+    if (!begin) return false;
+
+    std::set<std::string> done;
+    bool changed = false;
+    for (bool pending = true; pending; ) {
+        pending = false;
+        FlowGraph g(cg);
+        Dominators dom(&g);
+        Loops loops(&g, dom);
+        ReachingDefs reach(&g);
+        Liveness live(&g);
+        std::vector<int> reducedIn;
+        for (int i = 0; i < loops.NumLoops(); i++) {
+            const Loop &l = loops.At(i);
+            Instruction *first = g.Block(l.header).instrs[0].instr;
+            std::string key = first->GetKind() == I_Label
+                            ? dynamic_cast<Label*>(first)->text() : "";
+            if (done.count(key)) continue;
+            bool stale = false;
+            for (int k = 0; k < reducedIn.size() && !stale; k++)
+                stale = loops.Contains(i, reducedIn[k])
+                     || loops.Contains(reducedIn[k], i);
+            if (stale) {
+                pending = true;
+                continue;
+            }
+            done.insert(key);
+            Reducer r(cg, begin, &g, &reach, &live, l);
+            if (r.Run()) {
+                reducedIn.push_back(i);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,31 @@
+
+
+#ifndef _H_ivsr
+#define _H_ivsr
+
+#include "optimizer.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class StrengthReduction: public Pass
+{
+  public:
+    const char *Name() { return "ivsr"; }
+    bool Run(CodeGenerator *cg);
+};
+
+#endif
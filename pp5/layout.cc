@@ -0,0 +1,228 @@
+
+
+#include "layout.h"
+#include <stdlib.h>
+#include <string.h>
+#include "codegen.h"
+
+typedef std::list<Instruction*>::iterator Iter;
+
+static const int MaxTestSize = 8;
+
+static bool IsLabel(Instruction *instr, const char *label) {
+    return instr->GetKind() == I_Label
+        && !strcmp(dynamic_cast<Label*>(instr)->text(), label);
+}
+
+static bool IsHalt(Instruction *instr) {
+    return instr->GetKind() == I_LCall
+        && !strcmp(dynamic_cast<LCall*>(instr)->GetLabel(), "_Halt");
+}
+
+static bool FallsThrough(Instruction *instr) {
+    instrT kind = instr->GetKind();
+    return kind != I_Goto && kind != I_Return && !IsHalt(instr);
+}
+
+
+
+
+static bool IsTestCode(Instruction *instr) {
+    switch (instr->GetKind()) {
+      case I_LoadConstant:
+      case I_LoadLabel:
+      case I_Assign:
+      case I_Load:
+      case I_BinaryOp:
+        return true;
+      default:
+        return false;
+    }
+}
+
+static bool LabelFollows(std::list<Instruction*> *code, Iter p,
+                         const char *label) {
+    for (; p != code->end() && (*p)->GetKind() == I_Label; ++p)
+        if (IsLabel(*p, label)) return true;
+    return false;
+}
+
+static Instruction *Copy(Instruction *instr) {
+    Location *uses[Instruction::MaxUses];
+    instr->GetUses(uses);
+    Location *dst = instr->GetDst();
+    switch (instr->GetKind()) {
+      case I_LoadConstant:
+        return new LoadConstant(dst,
+                                dynamic_cast<LoadConstant*>(instr)->GetValue());
+      case I_LoadLabel:
+        return new LoadLabel(dst, dynamic_cast<LoadLabel*>(instr)->GetLabel());
+      case I_Assign:
+        return new Assign(dst, uses[0]);
+      case I_Load:
+        return new Load(dst, uses[0], dynamic_cast<Load*>(instr)->GetOffset());
+      case I_BinaryOp:
+        return new BinaryOp(dynamic_cast<BinaryOp*>(instr)->GetOpCode(), dst,
+                            uses[0], uses[1]);
+      default:
+        return NULL;
+    }
+}
+
+
+
+
+
+
+
+
+
+static bool Rotate(CodeGenerator *cg, Iter header) {
+    std::list<Instruction*> *code = cg->GetCode();
+    const char *top = dynamic_cast<Label*>(*header)->text();
+    Iter p = std::next(header);
+    for (int size = 0; p != code->end() && IsTestCode(*p); ++p)
+        if (++size > MaxTestSize) return false;
+    if (p == code->end() || (*p)->GetKind() != I_IfZ) return false;
+    IfZ *exit = dynamic_cast<IfZ*>(*p);
+    if (exit->IsNonZero()) return false;
+
+    Iter body = std::next(p), latch = code->end();
+    for (Iter q = body; q != code->end() && latch == code->end(); ++q) {
+        if ((*q)->GetKind() == I_EndFunc) return false;
+        if ((*q)->GetKind() == I_Goto
+            && !strcmp(dynamic_cast<Goto*>(*q)->branch_label(), top)
+            && LabelFollows(code, std::next(q), exit->branch_label()))
+            latch = q;
+    }
+    if (latch == code->end()) return false;
+
+    char *fresh = NULL;
+    if ((*body)->GetKind() != I_Label) {
+        fresh = cg->NewLabel();
+        body = code->insert(body, new Label(fresh));
+    }
+    const char *again = dynamic_cast<Label*>(*body)->text();
+    for (Iter q = std::next(header); q != p; ++q)
+        code->insert(latch, Copy(*q));
+    Location *test;
+    exit->GetUses(&test);
+    code->insert(latch, new IfZ(test, again, true));
+    delete *latch;
+    code->erase(latch);
+    free(fresh);
+    return true;
+}
+
+bool LoopRotation::Run(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    bool changed = false;
+    for (Iter p = code->begin(); p != code->end(); ++p)
+        if ((*p)->GetKind() == I_Label && Rotate(cg, p))
+            changed = true;
+    return changed;
+}
+
+
+
+
+static Iter FindLabel(Iter from, Iter end, const char *label) {
+    for (; from != end; ++from)
+        if (IsLabel(*from, label)) return from;
+    return end;
+}
+
+
+
+
+
+
+static bool SelfContained(std::list<Instruction*> *code, Iter first,
+                          Iter last) {
+    for (Iter p = first; p != last; ++p) {
+        const char *target = NULL;
+        if ((*p)->GetKind() == I_Goto)
+            target = dynamic_cast<Goto*>(*p)->branch_label();
+        else if ((*p)->GetKind() == I_IfZ)
+            target = dynamic_cast<IfZ*>(*p)->branch_label();
+        if (!target) continue;
+        bool before = true;
+        for (Iter q = first; q != code->end() && before; ++q)
+            if (IsLabel(*q, target)) before = false;
+        if (before) return false;
+    }
+    return true;
+}
+
+
+
+
+static bool FindStub(std::list<Instruction*> *code, Iter first, Iter end,
+                     const char *label, Iter *last) {
+    for (Iter p = first; p != end; ++p) {
+        instrT kind = (*p)->GetKind();
+        if (kind == I_Label || kind == I_Goto || kind == I_IfZ
+            || kind == I_Return)
+            return false;
+        if (IsHalt(*p)) {
+            *last = std::next(p);
+            return LabelFollows(code, *last, label);
+        }
+    }
+    return false;
+}
+
+
+
+
+
+
+static bool FindElse(std::list<Instruction*> *code, Iter first, Iter end,
+                     const char *label, Iter *chunk, Iter *last) {
+    Iter e = FindLabel(first, end, label);
+    if (e == end || e == first) return false;
+    Instruction *prev = *std::prev(e);
+    if (prev->GetKind() != I_Goto) return false;
+    Iter join = FindLabel(e, end, dynamic_cast<Goto*>(prev)->branch_label());
+    if (join == end || !SelfContained(code, e, join)) return false;
+    *chunk = e;
+    *last = join;
+    return true;
+}
+
+bool BlockLayout::Run(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    Iter end = code->end();
+    for (Iter p = code->begin(); p != code->end(); ++p)
+        if ((*p)->GetKind() == I_EndFunc) end = p;
+    if (end == code->end()) return false;
+
+    bool changed = false;
+    for (Iter p = code->begin(); p != end; ++p) {
+        if ((*p)->GetKind() != I_IfZ) continue;
+        IfZ *branch = dynamic_cast<IfZ*>(*p);
+        if (branch->IsNonZero()) continue;
+        const char *label = branch->branch_label();
+        Iter first = std::next(p), last;
+        Instruction *join = NULL;
+        if (FindStub(code, first, end, label, &last)) {
+            char *cold = cg->NewLabel();
+            branch->SetBranchLabel(cold);
+            branch->Negate();
+            first = code->insert(first, new Label(cold));
+            free(cold);
+        } else if (FindElse(code, first, end, label, &first, &last)) {
+            if (FallsThrough(*std::prev(last)))
+                join = new Goto(dynamic_cast<Label*>(*last)->text());
+        } else {
+            continue;
+        }
+
+        if (!changed && FallsThrough(*std::prev(end)))
+            code->insert(end, new Return(NULL));
+        code->splice(end, *code, first, last);
+        if (join) code->insert(end, join);
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,44 @@
+
+
+#ifndef _H_layout
+#define _H_layout
+
+#include "optimizer.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class LoopRotation: public Pass
+{
+  public:
+    const char *Name() { return "loop-rotation"; }
+    bool Run(CodeGenerator *cg);
+};
+
+
+
+
+
+
+
+
+
+
+class BlockLayout: public Pass
+{
+  public:
+    const char *Name() { return "block-layout"; }
+    bool Run(CodeGenerator *cg);
+};
+
+#endif
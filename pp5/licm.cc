@@ -0,0 +1,281 @@
+
+
+#include "licm.h"
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "codegen.h"
+#include "dataflow.h"
+
+static const char *BranchTarget(Instruction *instr) {
+    if (instr->GetKind() == I_Goto)
+        return dynamic_cast<Goto*>(instr)->branch_label();
+    if (instr->GetKind() == I_IfZ)
+        return dynamic_cast<IfZ*>(instr)->branch_label();
+    return NULL;
+}
+
+static void SetBranchTarget(Instruction *instr, const char *label) {
+    if (instr->GetKind() == I_Goto)
+        dynamic_cast<Goto*>(instr)->SetBranchLabel(label);
+    else
+        dynamic_cast<IfZ*>(instr)->SetBranchLabel(label);
+}
+
+class Hoister
+{
+  public:
+    Hoister(CodeGenerator *cg, FlowGraph *g, const Dominators *dom,
+            const ReachingDefs *reach, const Liveness *live, const Loop &l)
+      : cg(cg), g(g), dom(dom), reach(reach), live(live), loop(l),
+        hoisted(reach->NumDefs()), callWritesGlobals(false),
+        callWritesMemory(false), hasStore(false),
+        hasFieldStore(false), headerEffect(-1) {}
+
+    bool Run();
+
+  private:
+    CodeGenerator *cg;
+    FlowGraph *g;
+    const Dominators *dom;
+    const ReachingDefs *reach;
+    const Liveness *live;
+    const Loop &loop;
+    std::vector<int> blocks;
+    BitSet loopDefs, hoisted;
+    std::unordered_map<int, int> defCount;
+    bool callWritesGlobals, callWritesMemory, hasStore, hasFieldStore;
+    int headerEffect;
+    std::vector<FlowInstr*> moved;
+
+    bool Scan();
+    bool Invariant(int loc, const BitSet &reaching);
+    bool SafeLoad(int b, int i);
+    bool Candidate(int b, int i, const BitSet &reaching);
+    bool Place();
+};
+
+
+
+
+
+
+bool Hoister::Scan() {
+    BasicBlock &header = g->Block(loop.header);
+    if (loop.header == 0 || header.instrs.empty()
+        || header.instrs[0].instr->GetKind() != I_Label)
+        return false;
+    const char *label = dynamic_cast<Label*>(header.instrs[0].instr)->text();
+    for (int k = 0; k < loop.latches.size(); k++) {
+        const char *target =
+            BranchTarget(g->Block(loop.latches[k]).instrs.back().instr);
+        if (!target || strcmp(target, label)) return false;
+    }
+
+    const std::vector<int> &order = g->Order();
+    for (int k = 0; k < order.size(); k++)
+        if (loop.blocks.Test(order[k])) blocks.push_back(order[k]);
+
+    loopDefs = BitSet(reach->NumDefs());
+    for (int k = 0; k < blocks.size(); k++) {
+        int b = blocks[k];
+        std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+        BitSet reaching = reach->ReachIn(b);
+        for (int i = 0; i < instrs.size(); i++) {
+            FlowInstr &fi = instrs[i];
+            bool effect = fi.call || fi.halt;
+            if (fi.def >= 0) {
+                loopDefs.Set(reach->DefAt(b, i));
+                defCount[fi.def]++;
+            }
+            if (fi.effects & EF_WritesGlobals) callWritesGlobals = true;
+            if (fi.effects & EF_WritesMemory) callWritesMemory = true;
+            if (fi.instr->GetKind() == I_Store) {
+                int d = reach->UniqueDef(fi.uses[0], reaching);
+                BinaryOp *addr = d >= 0
+                    ? dynamic_cast<BinaryOp*>(reach->DefInstr(d)) : NULL;
+                bool element = addr && addr->GetOpCode() == BinaryOp::Add
+                    && dynamic_cast<Store*>(fi.instr)->GetOffset() == 0;
+                hasStore = true;
+                if (!element) hasFieldStore = true;
+                effect = true;
+            }
+            if (effect && b == loop.header && headerEffect < 0)
+                headerEffect = i;
+            reach->Step(b, i, &reaching);
+        }
+    }
+    if (headerEffect < 0) headerEffect = header.instrs.size();
+    return true;
+}
+
+
+
+
+bool Hoister::Invariant(int loc, const BitSet &reaching) {
+    if (g->Globals().Test(loc) && callWritesGlobals) return false;
+    const std::vector<int> &defs = reach->DefList(loc);
+    int inside = -1, count = 0;
+    for (int k = 0; k < defs.size(); k++) {
+        if (!reaching.Test(defs[k])) continue;
+        count++;
+        if (loopDefs.Test(defs[k])) inside = defs[k];
+    }
+    return inside < 0 || (count == 1 && hoisted.Test(inside));
+}
+
+
+
+
+
+
+
+
+
+
+bool Hoister::SafeLoad(int b, int i) {
+    FlowInstr &fi = g->Block(b).instrs[i];
+    int offset = dynamic_cast<Load*>(fi.instr)->GetOffset();
+    Location *base = g->LocationAt(fi.uses[0]);
+    bool field = offset >= 0 && base->GetSegment() == fpRelative
+              && !strcmp(base->GetName(), "this");
+
+    bool clobbered = offset != -4
+                  && (callWritesMemory
+                      || (field ? hasFieldStore : hasStore));
+    if (clobbered) return false;
+    return field || (b == loop.header && i < headerEffect);
+}
+
+bool Hoister::Candidate(int b, int i, const BitSet &reaching) {
+    FlowInstr &fi = g->Block(b).instrs[i];
+    if (fi.def < 0) return false;
+    switch (fi.instr->GetKind()) {
+      case I_LoadConstant:
+      case I_LoadLabel:
+      case I_Assign:
+        break;
+      case I_BinaryOp: {
+        BinaryOp::OpCode code = dynamic_cast<BinaryOp*>(fi.instr)->GetOpCode();
+        if (code == BinaryOp::Div || code == BinaryOp::Mod) return false;
+        break;
+      }
+      case I_Load:
+        if (!SafeLoad(b, i)) return false;
+        break;
+      default:
+        return false;
+    }
+
+    if (g->LocationAt(fi.def)->GetSegment() != fpRelative
+        || defCount[fi.def] != 1 || live->LiveIn(loop.header).Test(fi.def))
+        return false;
+    for (int k = 0; k < loop.exits.size(); k++) {
+        const std::pair<int, int> &e = loop.exits[k];
+        if (live->LiveIn(e.second).Test(fi.def) && !dom->Dominates(b, e.first))
+            return false;
+    }
+    for (int k = 0; k < fi.numUses; k++)
+        if (!Invariant(fi.uses[k], reaching)) return false;
+    return true;
+}
+
+
+
+
+
+
+bool Hoister::Place() {
+    std::list<Instruction*> *code = cg->GetCode();
+    BasicBlock &header = g->Block(loop.header);
+    std::list<Instruction*>::iterator at = header.instrs[0].pos;
+    const char *label = dynamic_cast<Label*>(header.instrs[0].instr)->text();
+
+    char *preheader = NULL;
+    for (int k = 0; k < header.preds.size(); k++) {
+        int p = header.preds[k];
+        if (loop.blocks.Test(p)) continue;
+        Instruction *last = g->Block(p).instrs.back().instr;
+        const char *target = BranchTarget(last);
+        if (!target || strcmp(target, label)) continue;
+        if (!preheader) {
+            preheader = cg->NewLabel();
+            code->insert(at, new Label(preheader));
+        }
+        SetBranchTarget(last, preheader);
+    }
+    free(preheader);
+
+    for (int k = 0; k < moved.size(); k++)
+        code->splice(at, *code, moved[k]->pos);
+    return true;
+}
+
+bool Hoister::Run() {
+    if (!Scan()) return false;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int k = 0; k < blocks.size(); k++) {
+            int b = blocks[k];
+            std::vector<FlowInstr> &instrs = g->Block(b).instrs;
+            BitSet reaching = reach->ReachIn(b);
+            for (int i = 0; i < instrs.size(); i++) {
+                int d = reach->DefAt(b, i);
+                if (d >= 0 && !hoisted.Test(d)
+                    && Candidate(b, i, reaching)) {
+                    hoisted.Set(d);
+                    moved.push_back(&instrs[i]);
+                    changed = true;
+                }
+                reach->Step(b, i, &reaching);
+            }
+        }
+    }
+    return !moved.empty() && Place();
+}
+
+
+
+
+
+
+
+
+bool LoopInvariantMotion::Run(CodeGenerator *cg) {
+    std::set<std::string> done;
+    bool changed = false;
+    for (bool pending = true; pending; ) {
+        pending = false;
+        FlowGraph g(cg);
+        Dominators dom(&g);
+        Loops loops(&g, dom);
+        ReachingDefs reach(&g);
+        Liveness live(&g);
+        std::vector<int> hoistedFrom;
+        for (int i = 0; i < loops.NumLoops(); i++) {
+            const Loop &l = loops.At(i);
+            Instruction *first = g.Block(l.header).instrs[0].instr;
+            std::string key = first->GetKind() == I_Label
+                            ? dynamic_cast<Label*>(first)->text() : "";
+            if (done.count(key)) continue;
+            bool stale = false;
+            for (int k = 0; k < hoistedFrom.size() && !stale; k++)
+                stale = loops.Contains(i, hoistedFrom[k]);
+            if (stale) {
+                pending = true;
+                continue;
+            }
+            done.insert(key);
+            Hoister h(cg, &g, &dom, &reach, &live, l);
+            if (h.Run()) {
+                hoistedFrom.push_back(i);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
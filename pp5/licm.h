@@ -0,0 +1,30 @@
+
+
+#ifndef _H_licm
+#define _H_licm
+
+#include "optimizer.h"
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+class LoopInvariantMotion: public Pass
+{
+  public:
+    const char *Name() { return "licm"; }
+    bool Run(CodeGenerator *cg);
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "errors.h"
 
 class Node;
+class FnSummary;
 
 template<class Element> class List
 {
@@ -77,6 +78,18 @@ template<class Element> class List
             Nth(i)->Emit();
     }
 
+    void SummarizeAll(FnSummary *s) {
+        for (int i = 0; i < NumElements(); i++)
+            Nth(i)->Summarize(s);
+    }
+
+    
+    void DeleteAll() {
+        for (int i = 0; i < NumElements(); i++)
+            delete Nth(i);
+        elems.clear();
+    }
+
 };
 
 #endif
@@ -14,9 +14,6 @@ typedef struct yyltype
 #define YYLTYPE yyltype
 
 
-extern struct yyltype yylloc;
-
-
 inline yyltype Join(yyltype first, yyltype last) {
     yyltype combined;
     combined.first_column = first.first_column;
@@ -5,14 +5,41 @@
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "context.h"
+#include "driver.h"
+#include "server.h"
+#include "stats.h"
+#include "tacfile.h"
+#include "threadpool.h"
 
 
 int main(int argc, char *argv[]) {
     ParseCommandLine(argc, argv);
 
-    InitScanner();
+    const char *stats = GetOption("stats");
+    if (stats || IsDebugOn("time"))
+        Stats::Enable(stats && !strcmp(stats, "json"));
+
     InitParser();
-    yyparse();
-    return (ReportError::NumErrors() == 0 ? 0 : -1);
-}
+    if (GetOption("server"))
+        return RunServer();
+    int status;
+    if ((GetOption("client") || GetOption("server-stats"))
+        && RunClient(&status))
+        return status;
 
+    bool ok;
+    if (GetOption("load-tac")) {
+        ok = EmitTacFile(GetOption("load-tac"));
+    } else if (GetOption("batch")) {
+        ok = RunBatch(GetInputFiles());
+    } else if (GetInputFiles()->NumElements() > 0) {
+        ok = CompileFiles(GetInputFiles());
+    } else {
+        CompilationContext ctx;
+        ctx.jobs = ThreadPool::NumJobs();
+        ok = ctx.Compile(fileno(stdin));
+    }
+    Stats::Print();
+    return (ok ? 0 : -1);
+}
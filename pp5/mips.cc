@@ -1,8 +1,15 @@
 
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <algorithm>
 #include <cstring>
 #include "mips.h"
+#include "codegen.h"
+#include "context.h"
+#include "stackmap.h"
+#include "stats.h"
+#include "utility.h"
 
 
 
@@ -20,6 +27,7 @@ void Mips::SpillRegister(Location *dst, Register reg) {
     const char *offsetFromWhere = dst->GetSegment() == fpRelative
         ? regs[fp].name : regs[gp].name;
     Assert(dst->GetOffset() % 4 == 0); 
+    Stats::Count(S_Spills);
     Emit("sw %s, %d(%s)\t# spill %s from %s to %s%+d", regs[reg].name,
             dst->GetOffset(), offsetFromWhere, dst->GetName(), regs[reg].name,
             offsetFromWhere,dst->GetOffset());
@@ -44,10 +52,17 @@ void Mips::Emit(const char *fmt, ...) {
     va_start(args, fmt);
     vsprintf(buf, fmt, args);
     va_end(args);
-    if (buf[strlen(buf) - 1] != ':') printf("\t"); 
-    if (buf[0] != '#') printf("  ");   
-    printf("%s", buf);
-    if (buf[strlen(buf)-1] != '\n') printf("\n"); 
+
+    std::string line;
+    if (buf[strlen(buf) - 1] != ':') line += "\t"; 
+    if (buf[0] != '#') line += "  ";   
+    line += buf;
+    if (buf[strlen(buf)-1] != '\n') line += "\n"; 
+
+    if (out)
+        out->append(line);
+    else
+        fputs(line.c_str(), CompilationContext::Current()->out);
 }
 
 
@@ -59,14 +74,34 @@ void Mips::EmitLoadConstant(Location *dst, int val) {
 }
 
 
+static int StringLength(const char *literal) {
+    int n = 0;
+    for (const char *p = literal + 1; *p && *p != '"'; p++, n++)
+        if (*p == '\\' && p[1]) p++;
+    return n;
+}
+
+
+
+
+
+
+
+
+
 void Mips::EmitLoadStringConstant(Location *dst, const char *str) {
-    static int strNum = 1;
-    char label[16];
-    sprintf(label, "_string%d", strNum++);
-    Emit(".data\t\t\t# create string constant marked with label");
-    Emit("%s: .asciiz %s", label, str);
-    Emit(".text");
-    EmitLoadLabel(dst, label);
+    std::string &label = strings[str];
+    if (label.empty()) {
+        char name[32];
+        sprintf(name, "_string%d.%d", unit, strNum++);
+        label = name;
+        Emit(".data\t\t\t# create string constant marked with label");
+        Emit(".align 2");
+        Emit(".word %d\t\t# length of %s", StringLength(str), name);
+        Emit("%s: .asciiz %s", name, str);
+        Emit(".text");
+    }
+    EmitLoadLabel(dst, label.c_str());
 }
 
 
@@ -111,6 +146,7 @@ void Mips::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
 
 void Mips::EmitLabel(const char *label) {
     Emit("%s:", label);
+    if (!strcmp(label, "main")) inMain = true;
 }
 
 
@@ -119,10 +155,14 @@ void Mips::EmitGoto(const char *label) {
 }
 
 
-void Mips::EmitIfZ(Location *test, const char *label) {
+void Mips::EmitIfZ(Location *test, const char *label, bool nonZero) {
     FillRegister(test, rs);
-    Emit("beqz %s, %s\t# branch if %s is zero ", regs[rs].name, label,
-            test->GetName());
+    if (nonZero)
+        Emit("bnez %s, %s\t# branch if %s is nonzero ", regs[rs].name, label,
+                test->GetName());
+    else
+        Emit("beqz %s, %s\t# branch if %s is zero ", regs[rs].name, label,
+                test->GetName());
 }
 
 
@@ -143,16 +183,78 @@ void Mips::EmitCallInstr(Location *result, const char *fn, bool isLabel) {
 }
 
 
+void Mips::EmitStackMap() {
+    if (!stackMap) return;
+    std::string words;
+    char buf[32];
+    const std::vector<int> *lists[] = { &stackMap->refs, &stackMap->derived };
+    for (int k = 0; k < 2; k++) {
+        sprintf(buf, "%s%d", k ? ", " : "", (int)lists[k]->size());
+        words += buf;
+        for (int i = 0; i < lists[k]->size(); i++) {
+            sprintf(buf, ", %d", (*lists[k])[i]);
+            words += buf;
+        }
+    }
+    std::string &label = maps[words];
+    if (label.empty() && words == "0, 0") {
+        label = "_gc_nomap";
+    } else if (label.empty()) {
+        char name[32];
+        sprintf(name, "_gcmap%d.%d", unit, mapNum++);
+        label = name;
+        Emit(".data\t\t\t# stack map: live references, derived pointers");
+        Emit(".align 2");
+        Emit("%s: .word %s", name, words.c_str());
+        Emit(".text");
+    }
+    Emit("la %s, %s\t# record stack map for the collector", regs[rd].name,
+            label.c_str());
+    Emit("sw %s, %d(%s)", regs[rd].name, CodeGenerator::OffsetToStackMap,
+            regs[fp].name);
+    stackMap = NULL;
+}
+
+
 void Mips::EmitLCall(Location *dst, const char *label) {
+    if (tailBytes >= 0) {
+        EmitTailCall(label, true);
+        return;
+    }
+    EmitStackMap();
     EmitCallInstr(dst, label, true);
 }
 
 void Mips::EmitACall(Location *dst, Location *fn) {
+    if (tailBytes < 0) EmitStackMap();
     FillRegister(fn, rs);
+    if (tailBytes >= 0) {
+        EmitTailCall(regs[rs].name, false);
+        return;
+    }
     EmitCallInstr(dst, regs[rs].name, false);
 }
 
 
+
+
+
+
+void Mips::EmitTailCall(const char *fn, bool isL) {
+    for (int offset = 4; offset <= tailBytes; offset += 4) {
+        Emit("lw %s, %d($sp)\t# move arg into our own param slot",
+                regs[rd].name, offset);
+        Emit("sw %s, %d($fp)", regs[rd].name, offset);
+    }
+    Emit("move $sp, $fp\t\t# pop callee frame off stack");
+    Emit("lw $ra, -4($fp)\t# restore saved ra");
+    Emit("lw $fp, 0($fp)\t# restore saved fp");
+    Emit("%s %s\t\t# tail call returns straight to our caller",
+            isL ? "j" : "jr", fn);
+    tailBytes = -1;
+}
+
+
 void Mips::EmitPopParams(int bytes) {
     if (bytes != 0)
         Emit("add $sp, $sp, %d\t# pop params off stack", bytes);
@@ -165,6 +267,8 @@ void Mips::EmitReturn(Location *returnVal) {
         Emit("move $v0, %s\t\t# assign return value into $v0",
                 regs[rd].name);
     }
+    if (inMain)
+        Emit("jal _Exit\t\t# flush output, report collector statistics");
     Emit("move $sp, $fp\t\t# pop callee frame off stack");
     Emit("lw $ra, -4($fp)\t# restore saved ra");
     Emit("lw $fp, 0($fp)\t# restore saved fp");
@@ -172,8 +276,11 @@ void Mips::EmitReturn(Location *returnVal) {
 }
 
 
-void Mips::EmitBeginFunction(int stackFrameSize) {
+void Mips::EmitBeginFunction(int stackFrameSize, int numParamBytes) {
     Assert(stackFrameSize >= 0);
+    Stats::Count(S_Functions);
+    Stats::Count(S_FrameBytes, stackFrameSize + 8);
+    paramSize = numParamBytes;
     Emit("subu $sp, $sp, 8\t# decrement sp to make space to save ra, fp");
     Emit("sw $fp, 8($sp)\t# save fp");
     Emit("sw $ra, 4($sp)\t# save ra");
@@ -183,6 +290,17 @@ void Mips::EmitBeginFunction(int stackFrameSize) {
         Emit(
             "subu $sp, $sp, %d\t# decrement sp to make space for locals/temps",
             stackFrameSize);
+    if (inMain) {
+        Emit("la %s, _gc_base\t# the collector stops walking frames here",
+                regs[rd].name);
+        Emit("sw $fp, 0(%s)", regs[rd].name);
+    }
+}
+
+
+void Mips::EmitClearSlots(const std::vector<int> &offsets) {
+    for (int i = 0; i < offsets.size(); i++)
+        Emit("sw $zero, %d($fp)\t# clear reference slot", offsets[i]);
 }
 
 
@@ -195,9 +313,14 @@ void Mips::EmitEndFunction() {
 
 
 
-void Mips::EmitVTable(const char *label, List<const char*> *methodLabels) {
+void Mips::EmitVTable(const char *label, List<const char*> *methodLabels,
+        List<int> *refOffsets) {
     Emit(".data");
     Emit(".align 2");
+    for (int i = refOffsets->NumElements() - 1; i >= 0; i--)
+        Emit(".word %d\t\t# reference field offset", refOffsets->Nth(i));
+    Emit(".word %d\t\t# number of reference fields",
+            refOffsets->NumElements());
     Emit("%s:\t\t# label for class %s vtable", label, label);
     for (int i = 0; i < methodLabels->NumElements(); i++)
         Emit(".word %s\n", methodLabels->Nth(i));
@@ -205,6 +328,24 @@ void Mips::EmitVTable(const char *label, List<const char*> *methodLabels) {
 }
 
 
+
+
+
+
+void Mips::EmitMemoTable(const char *fnLabel, int slots, int entryBytes) {
+    Emit(".data");
+    Emit("%s.memo.name: .asciiz \"%s\"", fnLabel,
+         fnLabel[0] == '_' ? fnLabel + 1 : fnLabel);
+    Emit(".align 2");
+    Emit("%s.memo:\t\t# memo table for %s", fnLabel, fnLabel);
+    Emit(".word 0\t\t# hits");
+    Emit(".word 0\t\t# misses");
+    Emit(".word %s.memo.name", fnLabel);
+    Emit(".space %d", slots * entryBytes);
+    Emit(".text");
+}
+
+
 void Mips::EmitPreamble() {
     Emit("# standard Decaf preamble ");
     Emit(".text");
@@ -213,6 +354,27 @@ void Mips::EmitPreamble() {
 }
 
 
+void Mips::EmitGlobalRoots(const std::vector<int> &offsets,
+                           const std::vector<std::string> &memoTables) {
+    std::vector<int> roots(offsets);
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+    Emit(".data");
+    Emit(".align 2");
+    Emit("_gc_globals:\t\t# gp offsets of global references");
+    Emit(".word %d", (int)roots.size());
+    for (int i = 0; i < roots.size(); i++)
+        Emit(".word %d", roots[i]);
+    Emit("_gc_verbose: .word %d", IsDebugOn("gcstats") ? 1 : 0);
+    bool memoStats = IsDebugOn("memostats");
+    Emit("_memo_stats:\t\t# memo tables reported at exit");
+    Emit(".word %d", memoStats ? (int)memoTables.size() : 0);
+    for (int i = 0; memoStats && i < memoTables.size(); i++)
+        Emit(".word %s.memo", memoTables[i].c_str());
+    Emit(".text");
+}
+
+
 const char *Mips::NameForTac(BinaryOp::OpCode code) {
     Assert(code >=0 && code < BinaryOp::NumOps);
     const char *name = mipsName[code];
@@ -221,20 +383,15 @@ const char *Mips::NameForTac(BinaryOp::OpCode code) {
 }
 
 
-Mips::Mips() {
-    mipsName[BinaryOp::Add] = "add";
-    mipsName[BinaryOp::Sub] = "sub";
-    mipsName[BinaryOp::Mul] = "mul";
-    mipsName[BinaryOp::Div] = "div";
-    mipsName[BinaryOp::Mod] = "rem";
-    mipsName[BinaryOp::Eq] = "seq";
-    mipsName[BinaryOp::Ne] = "sne";
-    mipsName[BinaryOp::Lt] = "slt";
-    mipsName[BinaryOp::Le] = "sle";
-    mipsName[BinaryOp::Gt] = "sgt";
-    mipsName[BinaryOp::Ge] = "sge";
-    mipsName[BinaryOp::And] = "and";
-    mipsName[BinaryOp::Or] = "or";
+Mips::Mips(std::string *buf, int u) {
+    out = buf;
+    unit = u;
+    strNum = 1;
+    stackMap = NULL;
+    mapNum = 0;
+    inMain = false;
+    paramSize = 0;
+    tailBytes = -1;
     regs[zero] = (RegContents){false, NULL, "$zero", false};
     regs[at] = (RegContents){false, NULL, "$at", false};
     regs[v0] = (RegContents){false, NULL, "$v0", false};
@@ -270,5 +427,9 @@ Mips::Mips() {
     rs = t0; rt = t1; rd = t2;
 }
 
-const char *Mips::mipsName[BinaryOp::NumOps];
+const char * const Mips::mipsName[BinaryOp::NumOps] = {
+    "add", "sub", "mul", "div", "rem",
+    "seq", "sne", "slt", "sle", "sgt", "sge",
+    "and", "or"
+};
 
@@ -3,10 +3,14 @@
 #ifndef _H_mips
 #define _H_mips
 
+#include <map>
+#include <string>
+#include <vector>
 #include "tac.h"
 #include "list.h"
 
 class Location;
+struct StackMap;
 
 class Mips
 {
@@ -33,16 +37,30 @@ class Mips
     void SpillRegister(Location *dst, Register reg);
 
     void EmitCallInstr(Location *dst, const char *fn, bool isL);
+    void EmitTailCall(const char *fn, bool isL);
+    void EmitStackMap();
 
-    static const char *mipsName[BinaryOp::NumOps];
+    static const char * const mipsName[BinaryOp::NumOps];
     static const char *NameForTac(BinaryOp::OpCode code);
 
     Instruction* currentInstruction;
 
+    
+    
+    std::string *out;
+    int unit;
+    int strNum;
+    std::map<std::string, std::string> strings;
+    const StackMap *stackMap;
+    int mapNum;
+    std::map<std::string, std::string> maps;
+    bool inMain;
+    int paramSize, tailBytes;
+
  public:
-    Mips();
+    Mips(std::string *out = NULL, int unit = 0);
 
-    static void Emit(const char *fmt, ...);
+    void Emit(const char *fmt, ...);
 
     void EmitLoadConstant(Location *dst, int val);
     void EmitLoadStringConstant(Location *dst, const char *str);
@@ -57,10 +75,10 @@ class Mips
 
     void EmitLabel(const char *label);
     void EmitGoto(const char *label);
-    void EmitIfZ(Location *test, const char*label);
+    void EmitIfZ(Location *test, const char*label, bool nonZero = false);
     void EmitReturn(Location *returnVal);
 
-    void EmitBeginFunction(int frameSize);
+    void EmitBeginFunction(int frameSize, int paramSize);
     void EmitEndFunction();
 
     void EmitParam(Location *arg);
@@ -68,9 +86,24 @@ class Mips
     void EmitACall(Location *result, Location *fnAddr);
     void EmitPopParams(int bytes);
 
-    void EmitVTable(const char *label, List<const char*> *methodLabels);
+    void EmitVTable(const char *label, List<const char*> *methodLabels,
+                    List<int> *refOffsets);
+    void EmitMemoTable(const char *fnLabel, int slots, int entryBytes);
 
     void EmitPreamble();
+    void EmitGlobalRoots(const std::vector<int> &offsets,
+                         const std::vector<std::string> &memoTables);
+
+
+    void SetStackMap(const StackMap *m) { stackMap = m; }
+
+    
+    
+    
+    
+    bool CanTailCall(int argBytes) { return !inMain && argBytes <= paramSize; }
+    void SetTailCall(int argBytes) { tailBytes = argBytes; }
+    void EmitClearSlots(const std::vector<int> &offsets);
 
     class CurrentInstruction;
 };
@@ -0,0 +1,340 @@
+
+
+#include "optimizer.h"
+#include <ctype.h>
+#include <set>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include "codegen.h"
+#include "context.h"
+#include "dataflow.h"
+#include "gvn.h"
+#include "ivsr.h"
+#include "layout.h"
+#include "licm.h"
+#include "stats.h"
+#include "tailcall.h"
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool IsLocalLabel(const char *label) {
+    if (strncmp(label, "_L", 2) != 0 || !isdigit((unsigned char)label[2]))
+        return false;
+    const char *p = label + 2;
+    while (isdigit((unsigned char)*p)) p++;
+    if (*p++ != '.' || !isdigit((unsigned char)*p)) return false;
+    while (isdigit((unsigned char)*p)) p++;
+    return *p == '\0';
+}
+
+static const char *BranchTarget(Instruction *instr) {
+    if (instr->GetKind() == I_Goto)
+        return dynamic_cast<Goto*>(instr)->branch_label();
+    if (instr->GetKind() == I_IfZ)
+        return dynamic_cast<IfZ*>(instr)->branch_label();
+    return NULL;
+}
+
+
+
+
+class UnreachableCode: public Pass
+{
+  public:
+    const char *Name() { return "unreachable-code"; }
+
+    bool Run(CodeGenerator *cg) {
+        std::list<Instruction*> *code = cg->GetCode();
+        bool changed = false, dead = false;
+        for (auto p = code->begin(); p != code->end(); ) {
+            instrT kind = (*p)->GetKind();
+            if (kind == I_Label || kind == I_BeginFunc || kind == I_EndFunc)
+                dead = false;
+            if (dead) {
+                delete *p;
+                p = code->erase(p);
+                changed = true;
+                continue;
+            }
+            if (kind == I_Goto || kind == I_Return) dead = true;
+            ++p;
+        }
+        return changed;
+    }
+};
+
+
+
+
+class BranchToNext: public Pass
+{
+  public:
+    const char *Name() { return "branch-to-next"; }
+
+    bool Run(CodeGenerator *cg) {
+        std::list<Instruction*> *code = cg->GetCode();
+        bool changed = false;
+        for (auto p = code->begin(); p != code->end(); ) {
+            const char *target = BranchTarget(*p);
+            bool next = false;
+            if (target) {
+                for (auto q = std::next(p); q != code->end()
+                         && (*q)->GetKind() == I_Label; ++q)
+                    if (!strcmp(dynamic_cast<Label*>(*q)->text(), target))
+                        next = true;
+            }
+            if (next) {
+                delete *p;
+                p = code->erase(p);
+                changed = true;
+            } else {
+                ++p;
+            }
+        }
+        return changed;
+    }
+};
+
+
+
+
+class DeadLabels: public Pass
+{
+  public:
+    const char *Name() { return "dead-labels"; }
+
+    bool Run(CodeGenerator *cg) {
+        std::list<Instruction*> *code = cg->GetCode();
+        std::set<std::string> used;
+        for (auto p = code->begin(); p != code->end(); ++p)
+            if (const char *target = BranchTarget(*p))
+                used.insert(target);
+
+        bool changed = false;
+        for (auto p = code->begin(); p != code->end(); ) {
+            Label *l = (*p)->GetKind() == I_Label
+                     ? dynamic_cast<Label*>(*p) : NULL;
+            if (l && IsLocalLabel(l->text()) && !used.count(l->text())) {
+                delete *p;
+                p = code->erase(p);
+                changed = true;
+            } else {
+                ++p;
+            }
+        }
+        return changed;
+    }
+};
+
+
+
+
+
+
+bool FindCallParams(std::list<Instruction*> *code,
+                    std::list<Instruction*>::iterator call,
+                    std::vector<std::list<Instruction*>::iterator> *params) {
+    std::vector<std::list<Instruction*>::iterator> found;
+    auto next = std::next(call);
+    int count = 0;
+    if (next != code->end() && (*next)->GetKind() == I_PopParams) {
+        count = dynamic_cast<PopParams*>(*next)->GetNumBytes()
+              / CodeGenerator::VarSize;
+        found.push_back(next);
+    }
+    for (auto p = call; count > 0 && p != code->begin(); ) {
+        switch ((*--p)->GetKind()) {
+          case I_PushParam:
+            found.push_back(p);
+            count--;
+            break;
+          case I_LoadConstant:
+          case I_LoadStringConstant:
+          case I_LoadLabel:
+          case I_Assign:
+          case I_Load:
+          case I_BinaryOp:
+            break;
+          default:
+            return false;
+        }
+    }
+    if (count > 0) return false;
+    params->insert(params->end(), found.begin(), found.end());
+    return true;
+}
+
+static bool IsRemovable(Instruction *instr) {
+    switch (instr->GetKind()) {
+      case I_LoadConstant:
+      case I_LoadStringConstant:
+      case I_LoadLabel:
+      case I_Assign:
+        return true;
+      case I_BinaryOp: {
+        BinaryOp::OpCode code = dynamic_cast<BinaryOp*>(instr)->GetOpCode();
+        return code != BinaryOp::Div && code != BinaryOp::Mod;
+      }
+      default:
+        return false;
+    }
+}
+
+class DeadStores: public Pass
+{
+  public:
+    const char *Name() { return "dead-stores"; }
+
+    bool Run(CodeGenerator *cg) {
+        std::list<Instruction*> *code = cg->GetCode();
+        FlowGraph g(cg);
+        Liveness live(&g);
+        std::vector<std::list<Instruction*>::iterator> params;
+        std::set<Instruction*> dropped;
+        bool changed = false;
+        for (int b = 0; b < g.NumBlocks(); b++) {
+            BitSet alive = live.LiveOut(b);
+            std::vector<FlowInstr> &instrs = g.Block(b).instrs;
+            for (int i = instrs.size() - 1; i >= 0; i--) {
+                FlowInstr &fi = instrs[i];
+                if (dropped.count(fi.instr)) continue;
+                if (fi.call && (fi.def < 0 || !alive.Test(fi.def))
+                    && !(fi.effects & ~(EF_ReadsGlobals | EF_ReadsMemory))
+                    && FindCallParams(code, fi.pos, &params)) {
+                    for (int k = 0; k < params.size(); k++)
+                        dropped.insert(*params[k]);
+                    delete fi.instr;
+                    code->erase(fi.pos);
+                    changed = true;
+                    continue;
+                }
+                if (fi.def >= 0 && !alive.Test(fi.def)
+                    && g.LocationAt(fi.def)->GetSegment() == fpRelative
+                    && IsRemovable(fi.instr)) {
+                    delete fi.instr;
+                    code->erase(fi.pos);
+                    changed = true;
+                    continue;
+                }
+                Liveness::Step(fi, g.Globals(), &alive);
+            }
+        }
+        for (int k = 0; k < params.size(); k++) {
+            delete *params[k];
+            code->erase(params[k]);
+        }
+        return changed;
+    }
+};
+
+PassManager::PassManager(int optLevel, int bisectLimit)
+  : bisectLimit(bisectLimit) {
+    if (optLevel >= 1) {
+        Add(new TailRecursion);
+        Add(new UnreachableCode);
+        Add(new BranchToNext);
+        Add(new DeadLabels);
+        Add(new UnreachableCode);
+        Add(new BranchToNext);
+        Add(new LoopRotation);
+        if (optLevel >= 2) {
+            Add(new LoopInvariantMotion);
+            Add(new StrengthReduction);
+            Add(new LoopInvariantMotion);
+            Add(new ValueNumbering);
+        }
+        Add(new BlockLayout);
+        Add(new BranchToNext);
+        Add(new DeadLabels);
+        Add(new DeadStores);
+    }
+}
+
+PassManager::~PassManager() {
+    for (int i = 0; i < passes.size(); i++)
+        delete passes[i];
+}
+
+PassManager *PassManager::ForContext() {
+    CompilationContext *ctx = CompilationContext::Current();
+    PassManager *pm = new PassManager(ctx->optLevel, ctx->bisectLimit);
+    if (pm->NumPasses() == 0) {
+        delete pm;
+        return NULL;
+    }
+    return pm;
+}
+
+void PassManager::Add(Pass *p) {
+    Record r = { 0, 0, 0, 0, 0 };
+    passes.push_back(p);
+    records.push_back(r);
+}
+
+static const char *UnitName(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    if (!code->empty() && code->front()->GetKind() == I_Label)
+        return dynamic_cast<Label*>(code->front())->text();
+    return "?";
+}
+
+
+
+
+
+
+
+
+
+
+void PassManager::Run(CodeGenerator *cg) {
+    std::list<Instruction*> *code = cg->GetCode();
+    bool isFunction = false;
+    for (auto p = code->begin(); p != code->end() && !isFunction; ++p)
+        isFunction = (*p)->GetKind() == I_BeginFunc;
+    if (!isFunction) return;
+
+    PhaseTimer t("optimize");
+    int n = passes.size();
+    for (int i = 0; i < n; i++) {
+        if (bisectLimit >= 0) {
+            long index = (long)(cg->GetUnit() - 1) * n + i + 1;
+            bool run = index <= bisectLimit;
+            fprintf(stderr, "BISECT: %srunning pass (%ld) %s on %s\n",
+                    run ? "" : "NOT ", index, passes[i]->Name(), UnitName(cg));
+            if (!run) continue;
+        }
+
+        long before = code->size();
+        double start = Now();
+        bool changed = passes[i]->Run(cg);
+        double ms = Now() - start;
+
+        std::lock_guard<std::mutex> g(lock);
+        Record &r = records[i];
+        r.ms += ms;
+        r.runs++;
+        r.changed += changed;
+        r.before += before;
+        r.after += code->size();
+    }
+    if (IsDebugOn("dataflow")) ReportDataflow(cg);
+}
+
+void PassManager::PrintReport(FILE *out) {
+    std::lock_guard<std::mutex> g(lock);
+    fprintf(out, "\n======== Pass Report ========\n");
+    fprintf(out, "%-3s %-18s %8s %8s %10s %10s %10s\n", "#", "pass", "runs",
+            "changed", "instrs-in", "instrs-out", "time(ms)");
+    for (int i = 0; i < passes.size(); i++) {
+        Record &r = records[i];
+        fprintf(out, "%-3d %-18s %8ld %8ld %10ld %10ld %10.3f\n", i + 1,
+                passes[i]->Name(), r.runs, r.changed, r.before, r.after, r.ms);
+    }
+    fprintf(out, "======== Pass Report ========\n");
+}
@@ -0,0 +1,76 @@
+
+
+#ifndef _H_optimizer
+#define _H_optimizer
+
+#include <list>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+#include "tac.h"
+
+class CodeGenerator;
+
+
+
+
+
+
+
+
+class Pass
+{
+  public:
+    virtual ~Pass() {}
+    virtual const char *Name() = 0;
+    virtual bool Run(CodeGenerator *cg) = 0;
+};
+
+
+
+
+
+
+
+
+
+bool FindCallParams(std::list<Instruction*> *code,
+                    std::list<Instruction*>::iterator call,
+                    std::vector<std::list<Instruction*>::iterator> *params);
+
+
+
+
+
+
+
+
+
+class PassManager
+{
+  public:
+    PassManager(int optLevel, int bisectLimit = -1);
+    ~PassManager();
+
+
+
+    static PassManager *ForContext();
+
+    void Add(Pass *p);
+    int NumPasses() { return passes.size(); }
+    void Run(CodeGenerator *cg);
+    void PrintReport(FILE *out);
+
+  private:
+    struct Record {
+        double ms;
+        long runs, changed, before, after;
+    };
+
+    std::vector<Pass*> passes;
+    std::vector<Record> records;
+    std::mutex lock;
+    int bisectLimit;
+};
+
+#endif
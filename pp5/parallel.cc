@@ -0,0 +1,62 @@
+
+
+#include "parallel.h"
+#include <stdio.h>
+#include "ast_decl.h"
+#include "context.h"
+#include "errors.h"
+#include "scope.h"
+
+thread_local ParallelCheck *ParallelCheck::active = NULL;
+
+ParallelCheck::ParallelCheck(int numJobs) : pool(numJobs) {
+    Assert(active == NULL);
+    active = this;
+    ReportError::SetBuffer(NewSegment());
+}
+
+ParallelCheck::~ParallelCheck() {
+    if (active == this) Finish();
+    for (int i = 0; i < segments.size(); i++)
+        delete segments[i];
+}
+
+std::string * ParallelCheck::NewSegment() {
+    std::string *s = new std::string;
+    segments.push_back(s);
+    return s;
+}
+
+bool ParallelCheck::Defer(Decl *fn) {
+    if (!active) return false;
+
+    
+    
+    std::string *buf = active->NewSegment();
+    scopeST *scope = ScopeM->Fork();
+    active->pool.Submit([fn, buf, scope] {
+        ScopeM = scope;
+        ReportError::SetBuffer(buf);
+        fn->Check(E_CheckType);
+        ReportError::SetBuffer(NULL);
+        ScopeM = NULL;
+        delete scope;
+    });
+    ReportError::SetBuffer(active->NewSegment());
+    return true;
+}
+
+void ParallelCheck::Finish() {
+    pool.WaitAll();
+    ReportError::SetBuffer(NULL);
+    active = NULL;
+
+    
+    
+    CompilationContext *ctx = CompilationContext::Current();
+    for (int i = 0; i < segments.size(); i++) {
+        ctx->WriteErrors(*segments[i]);
+        delete segments[i];
+    }
+    segments.clear();
+}
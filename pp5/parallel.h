@@ -0,0 +1,37 @@
+
+
+#ifndef _H_parallel
+#define _H_parallel
+
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+class Decl;
+
+
+
+class ParallelCheck
+{
+  public:
+    ParallelCheck(int numJobs);
+    ~ParallelCheck();
+
+    
+    
+    
+    static bool Defer(Decl *fn);
+
+    
+    
+    void Finish();
+
+  private:
+    ThreadPool pool;
+    std::vector<std::string*> segments;
+    static thread_local ParallelCheck *active;
+
+    std::string *NewSegment();
+};
+
+#endif
@@ -31,7 +31,7 @@
 #include "y.tab.h"
 #endif
 
-int yyparse();              // Defined in the generated y.tab.c file
+int yyparse(CompilationContext *ctx); // Defined in the generated y.tab.c file
 void InitParser();          // Defined in parser.y
 
 #endif
@@ -19,6 +19,8 @@
  *      After parsing completes, if no errors were found, the parser calls
  *      program->Emit() to kick off the code generation pass. The
  *      interesting work happens during the tree traversal.
+ *      (Both calls are now made by CompilationContext::Compile once
+ *      yyparse has returned the program.)
  *
  */
 
@@ -33,11 +35,24 @@
 #include "scanner.h" // for yylex
 #include "parser.h"
 #include "errors.h"
+#include "context.h"
 
-void yyerror(const char *msg); // standard error-handling routine
+// standard error-handling routine, given the location of the bad token
+void yyerror(yyltype *loc, CompilationContext *ctx, const char *msg);
 
 %}
 
+/* Reentrancy
+ * ----------
+ * The parser is pure: yylval and yylloc are locals of yyparse rather than
+ * globals, and the CompilationContext being compiled is passed through to
+ * yylex and yyerror. The context is only forward-declared in the header.
+ */
+%define api.pure full
+%locations
+%param { CompilationContext *ctx }
+%code requires { class CompilationContext; }
+
 /* The section before the first %% is the Definitions section of the yacc
  * input file. Here is where you declare tokens and types, add precedence
  * and associativity options, and so on.
@@ -45,7 +60,7 @@ void yyerror(const char *msg); // standard error-handling routine
 
 /* yylval
  * ------
- * Here we define the type of the yylval global variable that is used by
+ * Here we define the type of the yylval variable that is used by
  * the scanner to store attibute information about the token just scanned
  * and thus communicate that information to the parser.
  *
@@ -55,9 +70,9 @@ void yyerror(const char *msg); // standard error-handling routine
 %union {
     int integerConstant;
     bool boolConstant;
-    char *stringConstant;
+    TokenText stringConstant;
     double doubleConstant;
-    char identifier[MaxIdentLen+1]; // +1 for terminating null
+    TokenText identifier;           // at most MaxIdentLen characters
 
     Program *program;
 
@@ -181,12 +196,9 @@ Program   :    DeclList            {
                                       /* pp2: The @1 is needed to convince
                                        * yacc to set up yylloc. You can remove
                                        * it once you have other uses of @n */
-                                      Program *program = new Program($1);
-                                      // if no errors, advance to next phase
-                                      if (ReportError::NumErrors() == 0)
-                                          program->Check();
-                                      if (ReportError::NumErrors() == 0)
-                                          program->Emit();
+                                      // checking and code generation are
+                                      // run by the context after parsing
+                                      $$ = ctx->program = new Program($1);
                                     }
 ;
 
@@ -222,7 +234,12 @@ Type      :    T_Int                { $$ = Type::intType; }
           |    Type T_Dims          { $$ = new ArrayType(Join(@1, @2), $1); }
 ;
 
-FnDecl    :    FnHeader StmtBlock   { ($$=$1)->SetFunctionBody($2); }
+FnDecl    :    FnHeader StmtBlock   { ($$=$1)->SetFunctionBody($2);
+                                      /* the span from the return type to
+                                       * the closing brace keys the
+                                       * function in the --cache-dir cache */
+                                      $$->SetSourceSpan(@$);
+                                    }
 ;
 
 FnHeader  :    Type T_Identifier '(' Formals ')'
@@ -3,6 +3,10 @@
  * You should not need to modify this file. It declare a few constants,
  * types, variables,and functions that are used and/or exported by
  * the lex-generated scanner.
+ *
+ * The scanner is reentrant: all of its state lives in the
+ * CompilationContext it is given, so several files can be scanned at
+ * once on different threads.
  */
 
 #ifndef _H_scanner
@@ -12,13 +16,27 @@
 
 #define MaxIdentLen 31    // Maximum length for identifiers
 
-extern char *yytext;      // Text of lexeme just scanned
+// Text of an identifier or string token, as a view into the source
+// buffer (see source.h). It is not NUL-terminated.
+struct TokenText {
+    const char *text;
+    int len;
+};
 
-int yylex();              // Defined in the generated lex.yy.c file
-void yyrestart(FILE *fp); // ditto
+union YYSTYPE;
+struct yyltype;
+class CompilationContext;
 
-void InitScanner();                 // Defined in scanner.l user subroutines
-const char *GetLineNumbered(int n); // ditto
+// Defined in scanner.l user subroutines. yylex is called by the pure
+// parser with its own semantic value and location to fill in.
+int yylex(YYSTYPE *lval, struct yyltype *lloc, CompilationContext *ctx);
+
+void InitScanner(CompilationContext *ctx);   // Defined in scanner.l
+void FreeScanner(CompilationContext *ctx);   // ditto
+void ScanAll(CompilationContext *ctx);       // ditto
+
+// Line n of the source being compiled by the calling thread's context
+const char *GetLineNumbered(int n);          // ditto
 
 #endif
 
@@ -5,9 +5,10 @@
 #include "scope.h"
 #include "ast.h"
 #include "ast_decl.h"
+#include "stats.h"
 
 
-scopeST *ScopeM;
+thread_local scopeST *ScopeM;
 
 
 class Scope
@@ -29,6 +30,7 @@ class Scope
 
     bool HasHT() { return ht == NULL ? false : true; }
     void BuildHT() { ht = new Hashtable<Decl*>; }
+    void ReleaseHT() { delete ht; ht = NULL; }
     Hashtable<Decl*> * GetHT() { return ht; }
 
     bool HasParent() { return parent == NULL ? false : true; }
@@ -63,6 +65,17 @@ scopeST::scopeST() {
     id_cnt = 0;
 }
 
+scopeST::~scopeST() {
+    delete activeScopes;
+}
+
+
+scopeST * scopeST::Fork() {
+    scopeST *s = new scopeST(*this);
+    s->activeScopes = new std::vector<int>(*activeScopes);
+    return s;
+}
+
 
 void scopeST::ReEnter() {
     
@@ -297,6 +310,7 @@ int scopeST::InsertSymbol(Decl *decl) {
     }
 
     s->GetHT()->Enter(key, decl);
+    Stats::Count(S_Symbols);
     return id_cnt++;
 }
 
@@ -322,6 +336,13 @@ void scopeST::ExitScope() {
 }
 
 
+void scopeST::ReleaseScopes(int first, int last) {
+    for (int i = first; i <= last && i < scopes->size(); i++) {
+        scopes->at(i)->ReleaseHT();
+    }
+}
+
+
 void scopeST::SetScopeParent(const char *key) {
     scopes->at(cur_scope)->SetParent(key);
 }
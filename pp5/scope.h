@@ -24,6 +24,13 @@ class scopeST
 
   public:
     scopeST();
+    ~scopeST();
+
+    
+    
+    scopeST *Fork();
+    int GetScopeCount() { return scope_cnt; }
+    void SetScopeCount(int n) { scope_cnt = n; }
 
     
     void BuildScope();
@@ -49,6 +56,10 @@ class scopeST
     void ExitScope();
 
     
+    
+    void ReleaseScopes(int first, int last);
+
+    
     void SetScopeParent(const char *key);
     
     void SetInterface(const char *key);
@@ -64,7 +75,7 @@ class scopeST
 
 };
 
-extern scopeST *ScopeM;
+extern thread_local scopeST *ScopeM;
 
 #endif
 
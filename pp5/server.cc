@@ -0,0 +1,356 @@
+
+
+#include "server.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <errno.h>
+#include <mutex>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "context.h"
+#include "threadpool.h"
+#include "utility.h"
+
+
+
+static uint64_t Fnv1a(const char *p, size_t n,
+                      uint64_t h = 14695981039346656037ULL) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+
+
+
+static std::string OutputFlags(List<const char*> *keys) {
+    std::vector<std::string> sorted;
+    for (int i = 0; i < keys->NumElements(); i++)
+        sorted.push_back(keys->Nth(i));
+    std::sort(sorted.begin(), sorted.end());
+    std::string flags;
+    for (int i = 0; i < sorted.size(); i++)
+        flags += (i ? "," : "") + sorted[i];
+    return flags;
+}
+
+static std::string SocketPath(const char *option) {
+    const char *path = GetOption(option);
+    if (path && *path) return path;
+    if ((path = getenv("DCC_SOCKET")) && *path) return path;
+    return "/tmp/dcc-" + std::to_string(getuid()) + ".sock";
+}
+
+static bool WriteAll(int fd, const void *data, size_t n) {
+    const char *p = (const char *)data;
+    while (n > 0) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        n -= k;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t n) {
+    char *p = (char *)data;
+    while (n > 0) {
+        ssize_t k = read(fd, p, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        n -= k;
+    }
+    return true;
+}
+
+
+
+static bool SendFrame(int fd, const std::string &s) {
+    uint32_t n = s.size();
+    return WriteAll(fd, &n, sizeof n) && WriteAll(fd, s.data(), n);
+}
+
+static bool ReceiveFrame(int fd, std::string *s) {
+    uint32_t n;
+    if (!ReadAll(fd, &n, sizeof n)) return false;
+    s->resize(n);
+    return n == 0 || ReadAll(fd, &(*s)[0], n);
+}
+
+struct Result {
+    int32_t status;
+    std::string out, errors;
+};
+
+
+
+
+class ResultCache
+{
+  public:
+    ResultCache(size_t limit) : limit(limit), bytes(0), hits(0), misses(0) {}
+
+    bool Lookup(uint64_t key, const std::string &flags,
+                const std::string &source, Result *r) {
+        std::lock_guard<std::mutex> g(lock);
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.flags != flags
+            || it->second.source != source) {
+            misses++;
+            return false;
+        }
+        *r = it->second.result;
+        hits++;
+        return true;
+    }
+
+    void Insert(uint64_t key, const std::string &flags,
+                const std::string &source, const Result &r) {
+        std::lock_guard<std::mutex> g(lock);
+        if (entries.count(key)) return;
+        Entry &e = entries[key];
+        e.flags = flags;
+        e.source = source;
+        e.result = r;
+        bytes += Size(e);
+        order.push_back(key);
+        while (bytes > limit && order.size() > 1) {
+            auto old = entries.find(order.front());
+            bytes -= Size(old->second);
+            entries.erase(old);
+            order.pop_front();
+        }
+    }
+
+    std::string Report() {
+        std::lock_guard<std::mutex> g(lock);
+        char buf[128];
+        snprintf(buf, sizeof buf,
+                 "hits %ld misses %ld entries %zu bytes %zu\n",
+                 hits.load(), misses.load(), entries.size(), bytes);
+        return buf;
+    }
+
+  private:
+    struct Entry {
+        std::string flags, source;
+        Result result;
+    };
+
+    static size_t Size(const Entry &e) {
+        return e.flags.size() + e.source.size() + e.result.out.size()
+             + e.result.errors.size();
+    }
+
+    std::mutex lock;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::deque<uint64_t> order;
+    size_t limit, bytes;
+    std::atomic<long> hits, misses;
+};
+
+static void Compile(const std::string &flags, const std::string &source,
+                    Result *r) {
+    CompilationContext ctx;
+    while (ctx.debugKeys.NumElements() > 0)
+        ctx.debugKeys.RemoveAt(0);
+    std::vector<std::string> keys;
+    for (size_t start = 0; start < flags.size(); ) {
+        size_t comma = flags.find(',', start);
+        if (comma == std::string::npos) comma = flags.size();
+        keys.push_back(flags.substr(start, comma - start));
+        start = comma + 1;
+    }
+    ctx.optLevel = 0;
+    ctx.bisectLimit = -1;
+    for (int i = 0; i < keys.size(); i++) {
+        if (keys[i].compare(0, 2, "-O") == 0)
+            ctx.optLevel = atoi(keys[i].c_str() + 2);
+        else
+            ctx.debugKeys.Append(keys[i].c_str());
+    }
+
+    char *text = NULL;
+    size_t len = 0;
+    ctx.out = open_memstream(&text, &len);
+    ctx.errors = &r->errors;
+    ctx.jobs = 1;
+    bool ok = ctx.Compile(source.data(), source.size());
+    fclose(ctx.out);
+    r->out.assign(text, len);
+    free(text);
+    r->status = ok ? 0 : -1;
+}
+
+static void Serve(int fd, ResultCache *cache) {
+    char kind;
+    if (!ReadAll(fd, &kind, 1)) return;
+    if (kind == 'S') {
+        SendFrame(fd, cache->Report());
+        return;
+    }
+
+    std::string flags, source;
+    if (kind != 'C' || !ReceiveFrame(fd, &flags)
+        || !ReceiveFrame(fd, &source))
+        return;
+
+    uint64_t key = Fnv1a(source.data(), source.size(),
+                         Fnv1a(flags.c_str(), flags.size() + 1));
+    Result r;
+    if (!cache->Lookup(key, flags, source, &r)) {
+        Compile(flags, source, &r);
+        cache->Insert(key, flags, source, r);
+    }
+    if (WriteAll(fd, &r.status, sizeof r.status) && SendFrame(fd, r.out))
+        SendFrame(fd, r.errors);
+}
+
+static const char *OtherOption(const char **allowed, int n) {
+    List<const char*> *set = GetOptionKeys();
+    for (int i = 0; i < set->NumElements(); i++) {
+        int j = 0;
+        while (j < n && strcmp(set->Nth(i), allowed[j])) j++;
+        if (j == n) return set->Nth(i);
+    }
+    return NULL;
+}
+
+int RunServer() {
+    static const char *serving[] = { "server", "cache-size", "jobs" };
+    const char *other = OtherOption(serving,
+                                    sizeof(serving) / sizeof(serving[0]));
+    if (other) {
+        fprintf(stderr, "The server takes compile options from each request;"
+                " give %s%s to the client instead\n",
+                strcmp(other, "O") ? "--" : "-", other);
+        return -1;
+    }
+    std::string path = SocketPath("server");
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path) {
+        fprintf(stderr, "Socket path '%s' is too long\n", path.c_str());
+        return -1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path.c_str());
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0
+        || listen(fd, 128) != 0) {
+        fprintf(stderr, "Unable to listen on '%s': %s\n", path.c_str(),
+                strerror(errno));
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *size = GetOption("cache-size");
+    ResultCache cache((size_t)(size ? atol(size) : 256) << 20);
+    int workers = GetOption("jobs") ? ThreadPool::NumJobs()
+                                    : std::thread::hardware_concurrency();
+    ThreadPool pool(workers > 0 ? workers : 1);
+    fprintf(stderr, "dcc: serving on %s\n", path.c_str());
+
+    for (;;) {
+        int conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK)
+                break;
+            fprintf(stderr, "dcc: accept failed: %s\n", strerror(errno));
+            usleep(100000);
+            continue;
+        }
+        pool.Submit([conn, &cache] {
+            Serve(conn, &cache);
+            close(conn);
+        });
+    }
+    fprintf(stderr, "dcc: accept failed: %s\n", strerror(errno));
+    close(fd);
+    unlink(path.c_str());
+    return -1;
+}
+
+static int Connect(const std::string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path) return -1;
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool RunClient(int *status) {
+    List<const char*> keys;
+    InheritDebugKeys(&keys);
+    for (int i = 0; i < keys.NumElements(); i++)
+        if (strcmp(keys.Nth(i), "tac")) return false;
+    static const char *forwarded[] = { "client", "server-stats", "O" };
+    if (OtherOption(forwarded, sizeof(forwarded) / sizeof(forwarded[0])))
+        return false;
+    std::string level = std::string("-O") + (GetOption("O") ? GetOption("O")
+                                                              : "0");
+    keys.Append(level.c_str());
+
+    int fd = Connect(SocketPath("client"));
+    if (fd < 0) {
+        if (!GetOption("server-stats")) return false;
+        fprintf(stderr, "No compile server is listening\n");
+        *status = -1;
+        return true;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    bool ok;
+    Result r;
+    if (GetOption("server-stats")) {
+        ok = WriteAll(fd, "S", 1) && ReceiveFrame(fd, &r.out);
+        r.status = 0;
+    } else {
+        std::string source;
+        char buf[1 << 16];
+        ssize_t n;
+        while ((n = read(fileno(stdin), buf, sizeof buf)) > 0)
+            source.append(buf, n);
+        ok = n == 0 && WriteAll(fd, "C", 1)
+          && SendFrame(fd, OutputFlags(&keys)) && SendFrame(fd, source)
+          && ReadAll(fd, &r.status, sizeof r.status)
+          && ReceiveFrame(fd, &r.out) && ReceiveFrame(fd, &r.errors);
+    }
+    close(fd);
+
+    if (!ok) {
+        fprintf(stderr, "Lost connection to the compile server\n");
+        *status = -1;
+        return true;
+    }
+    fwrite(r.out.data(), 1, r.out.size(), stdout);
+    fflush(stdout);
+    fputs(r.errors.c_str(), stderr);
+    *status = r.status;
+    return true;
+}
@@ -0,0 +1,27 @@
+
+
+#ifndef _H_server
+#define _H_server
+
+
+
+
+
+
+
+
+
+
+
+int RunServer();
+
+
+
+
+
+
+
+
+bool RunClient(int *status);
+
+#endif
@@ -0,0 +1,92 @@
+
+
+#include "source.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source::Source() {
+    buffer = NULL;
+    length = 0;
+    mapped = false;
+}
+
+Source::~Source() {
+    if (mapped)
+        munmap(buffer, length + 2);
+    else
+        free(buffer);
+}
+
+
+bool Source::Map(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return false;
+    if (lseek(fd, 0, SEEK_CUR) != 0) return false;
+
+    size_t size = st.st_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t tail = size % page;
+    if (tail == 0 || tail > page - 2) return false;
+
+    void *p = mmap(NULL, size + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return false;
+    buffer = (char *)p;
+    length = size;
+    mapped = true;
+    return true;
+}
+
+bool Source::Read(int fd) {
+    size_t cap = 1 << 16;
+    buffer = (char *)malloc(cap);
+    length = 0;
+    for (;;) {
+        if (cap - length < 4096 + 2) {
+            cap *= 2;
+            buffer = (char *)realloc(buffer, cap);
+        }
+        ssize_t n = read(fd, buffer + length, cap - length - 2);
+        if (n < 0) return false;
+        if (n == 0) break;
+        length += n;
+    }
+    buffer[length] = buffer[length + 1] = '\0';
+    return true;
+}
+
+bool Source::Load(int fd) {
+    return Map(fd) || Read(fd);
+}
+
+void Source::Load(const char *text, size_t len) {
+    buffer = (char *)malloc(len + 2);
+    memcpy(buffer, text, len);
+    buffer[len] = buffer[len + 1] = '\0';
+    length = len;
+}
+
+void Source::BuildLineIndex() {
+    const char *end = buffer + length;
+    const char *p = buffer;
+    while (p < end) {
+        lineStarts.push_back(p - buffer);
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        if (!nl) break;
+        p = nl + 1;
+    }
+}
+
+const char *Source::Line(int n, int *len) {
+    std::call_once(indexOnce, &Source::BuildLineIndex, this);
+    if (n <= 0 || n > lineStarts.size()) return NULL;
+
+    size_t start = lineStarts[n-1];
+    size_t end = (n < lineStarts.size()) ? lineStarts[n] - 1 : length;
+    if (end > start && buffer[end-1] == '\n') end--;
+    *len = end - start;
+    return buffer + start;
+}
@@ -0,0 +1,42 @@
+
+
+#ifndef _H_source
+#define _H_source
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+
+
+
+class Source
+{
+  public:
+    Source();
+    ~Source();
+
+    bool Load(int fd);
+    void Load(const char *text, size_t len);
+
+    char *Buffer() { return buffer; }
+    size_t Length() { return length; }
+
+
+
+
+    const char *Line(int n, int *len);
+
+  private:
+    char *buffer;
+    size_t length;
+    bool mapped;
+    std::vector<size_t> lineStarts;
+    std::once_flag indexOnce;
+
+    bool Map(int fd);
+    bool Read(int fd);
+    void BuildLineIndex();
+};
+
+#endif
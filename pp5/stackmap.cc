@@ -0,0 +1,67 @@
+
+
+#include "stackmap.h"
+#include "codegen.h"
+#include "dataflow.h"
+
+static bool MayCollect(Instruction *instr) {
+    return (instr->GetEffects() & EF_Allocates) != 0;
+}
+
+static void NoteKind(const FlowGraph &g, Location *l, std::vector<int> *kind) {
+    int i = g.IndexOf(l);
+    if (i >= 0 && l->GetRefKind() > (*kind)[i]) (*kind)[i] = l->GetRefKind();
+}
+
+
+
+
+
+
+StackMaps::StackMaps(CodeGenerator *cg) {
+    FlowGraph g(cg);
+    if (g.NumBlocks() == 0) return;
+    std::vector<int> kind(g.NumLocations(), NotRef);
+    std::list<Instruction*> *code = cg->GetCode();
+    for (auto p = code->begin(); p != code->end(); ++p) {
+        if (MayCollect(*p)) maps[*p];
+        Location *uses[Instruction::MaxUses];
+        int n = (*p)->GetUses(uses);
+        for (int k = 0; k < n; k++) NoteKind(g, uses[k], &kind);
+        if ((*p)->GetDst()) NoteKind(g, (*p)->GetDst(), &kind);
+    }
+
+    BitSet slots(g.NumLocations());
+    for (int i = 0; i < g.NumLocations(); i++)
+        if (kind[i] != NotRef && !g.Globals().Test(i)) slots.Set(i);
+    if (slots.First() < 0) return;
+
+    Liveness live(&g);
+    for (int b = 0; b < g.NumBlocks(); b++) {
+        std::vector<FlowInstr> &instrs = g.Block(b).instrs;
+        BitSet after = live.LiveOut(b);
+        for (int i = instrs.size() - 1; i >= 0; i--) {
+            const FlowInstr &fi = instrs[i];
+            if (MayCollect(fi.instr)) {
+                StackMap &m = maps.find(fi.instr)->second;
+                for (int s = slots.First(); s >= 0; s = slots.Next(s + 1)) {
+                    if (!after.Test(s) || s == fi.def) continue;
+                    int offset = g.LocationAt(s)->GetOffset();
+                    if (kind[s] == HeapRef) m.refs.push_back(offset);
+                    else m.derived.push_back(offset);
+                }
+            }
+            Liveness::Step(fi, g.Globals(), &after);
+        }
+    }
+
+    const BitSet &in = live.LiveIn(0);
+    for (int s = slots.First(); s >= 0; s = slots.Next(s + 1))
+        if (in.Test(s) && g.LocationAt(s)->GetOffset() < 0)
+            entry.push_back(g.LocationAt(s)->GetOffset());
+}
+
+const StackMap *StackMaps::At(Instruction *instr) const {
+    auto it = maps.find(instr);
+    return it == maps.end() ? NULL : &it->second;
+}
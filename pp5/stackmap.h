@@ -0,0 +1,44 @@
+
+
+#ifndef _H_stackmap
+#define _H_stackmap
+
+#include <unordered_map>
+#include <vector>
+#include "tac.h"
+
+class CodeGenerator;
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+struct StackMap {
+    std::vector<int> refs, derived;
+};
+
+class StackMaps
+{
+  public:
+    StackMaps(CodeGenerator *cg);
+    const StackMap *At(Instruction *instr) const;
+    const std::vector<int> &EntrySlots() const { return entry; }
+
+  private:
+    std::unordered_map<Instruction*, StackMap> maps;
+    std::vector<int> entry;
+};
+
+#endif
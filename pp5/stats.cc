@@ -0,0 +1,167 @@
+
+
+#include "stats.h"
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "tac.h"
+
+bool Stats::enabled = false;
+bool Stats::json = false;
+std::atomic<long> Stats::counters[NumCounters];
+std::atomic<long> Stats::instrs[NumInstrKinds];
+std::atomic<long> Stats::allocs, Stats::allocBytes;
+
+static const char *counterName[NumCounters] = {
+    "ast-nodes", "symbols", "functions", "tac-instrs", "spills", "frame-bytes",
+    "fn-cache-hits", "fn-cache-misses"
+};
+
+struct Phase {
+    const char *name;
+    double ms;
+    long allocs, bytes, calls;
+};
+
+
+
+
+static std::vector<Phase> phases;
+static std::vector<int> active;
+static std::thread::id timingThread;
+static double startTime, resumeTime;
+static long resumeAllocs, resumeBytes;
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int IndexOfPhase(const char *name) {
+    for (int i = 0; i < phases.size(); i++)
+        if (phases[i].name == name || !strcmp(phases[i].name, name)) return i;
+    Phase p = {name, 0, 0, 0, 0};
+    phases.push_back(p);
+    return phases.size() - 1;
+}
+
+
+
+static void ChargeActive(double now, long a, long b) {
+    if (!active.empty()) {
+        Phase &p = phases[active.back()];
+        p.ms += now - resumeTime;
+        p.allocs += a - resumeAllocs;
+        p.bytes += b - resumeBytes;
+    }
+    resumeTime = now;
+    resumeAllocs = a;
+    resumeBytes = b;
+}
+
+void Stats::Enable(bool asJson) {
+    enabled = true;
+    json = asJson;
+    timingThread = std::this_thread::get_id();
+    startTime = resumeTime = Now();
+}
+
+bool Stats::TimesThisThread() {
+    return enabled && std::this_thread::get_id() == timingThread;
+}
+
+void Stats::BeginPhase(const char *name) {
+    ChargeActive(Now(), allocs, allocBytes);
+    int i = IndexOfPhase(name);
+    phases[i].calls++;
+    active.push_back(i);
+}
+
+void Stats::EndPhase() {
+    ChargeActive(Now(), allocs, allocBytes);
+    active.pop_back();
+}
+
+void Stats::Print() {
+    if (!enabled) return;
+    fflush(stdout);
+    if (json)
+        PrintJson();
+    else
+        PrintHuman();
+}
+
+void Stats::PrintHuman() {
+    double total = Now() - startTime;
+    fprintf(stderr, "\n======== Compile Statistics ========\n");
+    fprintf(stderr, "%-18s %10s %8s %10s %12s\n", "phase", "time(ms)", "calls",
+            "allocs", "bytes");
+    for (int i = 0; i < phases.size(); i++) {
+        Phase &p = phases[i];
+        fprintf(stderr, "%-18s %10.3f %8ld %10ld %12ld\n", p.name, p.ms,
+                p.calls, p.allocs, p.bytes);
+    }
+    fprintf(stderr, "%-18s %10.3f %8s %10ld %12ld\n", "total", total, "",
+            (long)allocs, (long)allocBytes);
+
+    fprintf(stderr, "\n");
+    for (int i = 0; i < NumCounters; i++)
+        fprintf(stderr, "%-18s %10ld\n", counterName[i], (long)counters[i]);
+
+    fprintf(stderr, "\n");
+    for (int i = 0; i < NumInstrKinds; i++)
+        if (instrs[i])
+            fprintf(stderr, "%-18s %10ld\n", Instruction::kindName[i],
+                    (long)instrs[i]);
+    fprintf(stderr, "======== Compile Statistics ========\n");
+}
+
+void Stats::PrintJson() {
+    fprintf(stderr, "{\"total_ms\": %.3f, \"allocs\": %ld, \"alloc_bytes\": %ld",
+            Now() - startTime, (long)allocs, (long)allocBytes);
+
+    fprintf(stderr, ",\n \"phases\": [");
+    for (int i = 0; i < phases.size(); i++) {
+        Phase &p = phases[i];
+        fprintf(stderr, "%s\n  {\"name\": \"%s\", \"ms\": %.3f, \"calls\": %ld, "
+                "\"allocs\": %ld, \"bytes\": %ld}", i ? "," : "", p.name, p.ms,
+                p.calls, p.allocs, p.bytes);
+    }
+
+    fprintf(stderr, "],\n \"counters\": {");
+    for (int i = 0; i < NumCounters; i++)
+        fprintf(stderr, "%s\"%s\": %ld", i ? ", " : "", counterName[i],
+                (long)counters[i]);
+
+    fprintf(stderr, "},\n \"tac\": {");
+    bool first = true;
+    for (int i = 0; i < NumInstrKinds; i++) {
+        if (!instrs[i]) continue;
+        fprintf(stderr, "%s\"%s\": %ld", first ? "" : ", ",
+                Instruction::kindName[i], (long)instrs[i]);
+        first = false;
+    }
+    fprintf(stderr, "}}\n");
+}
+
+
+
+void *operator new(size_t size) {
+    Stats::NoteAlloc(size);
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    free(p);
+}
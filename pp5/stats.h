@@ -0,0 +1,81 @@
+
+
+#ifndef _H_stats
+#define _H_stats
+
+#include <atomic>
+#include <stddef.h>
+
+
+typedef enum {
+    S_AstNodes,
+    S_Symbols,
+    S_Functions,
+    S_TacInstrs,
+    S_Spills,
+    S_FrameBytes,
+    S_CacheHits,
+    S_CacheMisses,
+    NumCounters
+} counterT;
+
+class Stats
+{
+  public:
+
+
+    static void Enable(bool asJson);
+    static bool IsOn() { return enabled; }
+
+
+
+    static bool TimesThisThread();
+
+
+
+
+    static void BeginPhase(const char *name);
+    static void EndPhase();
+
+    static void Count(counterT c, long n = 1) {
+        if (enabled) counters[c] += n;
+    }
+    static void CountInstr(int kind) {
+        if (enabled) instrs[kind]++;
+    }
+    static void NoteAlloc(size_t bytes) {
+        if (enabled) { allocs++; allocBytes += bytes; }
+    }
+
+
+    static void Print();
+
+  private:
+    static bool enabled;
+    static bool json;
+    static std::atomic<long> counters[NumCounters];
+    static std::atomic<long> instrs[];
+    static std::atomic<long> allocs, allocBytes;
+
+    static void PrintHuman();
+    static void PrintJson();
+};
+
+
+
+class PhaseTimer
+{
+  public:
+    PhaseTimer(const char *name) : on(Stats::TimesThisThread()) {
+        if (on) Stats::BeginPhase(name);
+    }
+
+    ~PhaseTimer() {
+        if (on) Stats::EndPhase();
+    }
+
+  private:
+    bool on;
+};
+
+#endif
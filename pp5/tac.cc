@@ -2,13 +2,21 @@
 
 #include "tac.h"
 #include "mips.h"
+#include "tacfile.h"
+#include <cstdlib>
 #include <cstring>
 
 Location::Location(Segment s, int o, const char *name) :
-    variableName(strdup(name)), segment(s), offset(o), base(NULL) {}
+    variableName(strdup(name)), segment(s), offset(o), base(NULL),
+    refKind(NotRef) {}
 
 Location::Location(Segment s, int o, const char *name, Location *b) :
-    variableName(strdup(name)), segment(s), offset(o), base(b) {}
+    variableName(strdup(name)), segment(s), offset(o), base(b),
+    refKind(NotRef) {}
+
+Location::~Location() {
+    free((char *)variableName);
+}
 
 void Location::Print() {
     const char *s = (segment == fpRelative) ? "FP" : "GP";
@@ -16,8 +24,15 @@ void Location::Print() {
     printf(" ~~[%s,%s,%d,%s]", variableName, s, offset, b);
 }
 
-void Instruction::Print() {
-    printf("\t%s ;\n", printed);
+const char * const Instruction::kindName[NumInstrKinds] = {
+    "LoadConstant", "LoadStringConstant", "LoadLabel", "Assign", "Load",
+    "Store", "BinaryOp", "Label", "Goto", "IfZ", "BeginFunc", "EndFunc",
+    "Return", "PushParam", "PopParams", "LCall", "ACall", "VTable",
+    "MemoTable"
+};
+
+void Instruction::Print(FILE *out) {
+    fprintf(out, "\t%s ;\n", printed);
 }
 
 void Instruction::Emit(Mips *mips) {
@@ -37,30 +52,50 @@ void LoadConstant::EmitSpecific(Mips *mips) {
     mips->EmitLoadConstant(dst, val);
 }
 
-LoadStringConstant::LoadStringConstant(Location *d, const char *s)
+void LoadConstant::Save(TacWriter *w) {
+    w->Add(I_LoadConstant, w->Loc(dst), val);
+}
+
+LoadStringConstant::LoadStringConstant(Location *d, const char *s, int len)
   : dst(d) {
     Assert(dst != NULL && s != NULL);
-    const char *quote = (*s == '"') ? "" : "\"";
-    str = new char[strlen(s) + 2*strlen(quote) + 1];
-    sprintf(str, "%s%s%s", quote, s, quote);
+    const char *quote = (len > 0 && *s == '"') ? "" : "\"";
+    str = new char[len + 2*strlen(quote) + 1];
+    sprintf(str, "%s%.*s%s", quote, len, s, quote);
     quote = (strlen(str) > 50) ? "...\"" : "";
     sprintf(printed, "%s = %.50s%s", dst->GetName(), str, quote);
 }
 
+LoadStringConstant::~LoadStringConstant() {
+    delete[] str;
+}
+
 void LoadStringConstant::EmitSpecific(Mips *mips) {
     mips->EmitLoadStringConstant(dst, str);
 }
 
+void LoadStringConstant::Save(TacWriter *w) {
+    w->Add(I_LoadStringConstant, w->Loc(dst), w->String(str));
+}
+
 LoadLabel::LoadLabel(Location *d, const char *l)
   : dst(d), label(strdup(l)) {
     Assert(dst != NULL && label != NULL);
     sprintf(printed, "%s = %s", dst->GetName(), label);
 }
 
+LoadLabel::~LoadLabel() {
+    free((char *)label);
+}
+
 void LoadLabel::EmitSpecific(Mips *mips) {
     mips->EmitLoadLabel(dst, label);
 }
 
+void LoadLabel::Save(TacWriter *w) {
+    w->Add(I_LoadLabel, w->Loc(dst), w->String(label));
+}
+
 
 Assign::Assign(Location *d, Location *s)
   : dst(d), src(s) {
@@ -72,6 +107,14 @@ void Assign::EmitSpecific(Mips *mips) {
     mips->EmitCopy(dst, src);
 }
 
+void Assign::Save(TacWriter *w) {
+    w->Add(I_Assign, w->Loc(dst), w->Loc(src));
+}
+
+void Assign::SetUses(Location **uses) {
+    *this = Assign(dst, uses[0]);
+}
+
 Load::Load(Location *d, Location *s, int off)
   : dst(d), src(s), offset(off) {
     Assert(dst != NULL && src != NULL);
@@ -86,6 +129,14 @@ void Load::EmitSpecific(Mips *mips) {
     mips->EmitLoad(dst, src, offset);
 }
 
+void Load::Save(TacWriter *w) {
+    w->Add(I_Load, w->Loc(dst), w->Loc(src), offset);
+}
+
+void Load::SetUses(Location **uses) {
+    *this = Load(dst, uses[0], offset);
+}
+
 Store::Store(Location *d, Location *s, int off)
   : dst(d), src(s), offset(off) {
     Assert(dst != NULL && src != NULL);
@@ -100,6 +151,14 @@ void Store::EmitSpecific(Mips *mips) {
     mips->EmitStore(dst, src, offset);
 }
 
+void Store::Save(TacWriter *w) {
+    w->Add(I_Store, w->Loc(dst), w->Loc(src), offset);
+}
+
+void Store::SetUses(Location **uses) {
+    *this = Store(uses[0], uses[1], offset);
+}
+
 const char * const BinaryOp::opName[BinaryOp::NumOps] = {
     "+", "-", "*", "/", "%",
     "==", "!=", "<", "<=", ">", ">=",
@@ -126,41 +185,100 @@ void BinaryOp::EmitSpecific(Mips *mips) {
     mips->EmitBinaryOp(code, dst, op1, op2);
 }
 
+void BinaryOp::Save(TacWriter *w) {
+    w->Add(I_BinaryOp, code, w->Loc(dst), w->Loc(op1), w->Loc(op2));
+}
+
+void BinaryOp::SetUses(Location **uses) {
+    *this = BinaryOp(code, dst, uses[0], uses[1]);
+}
+
 Label::Label(const char *l) : label(strdup(l)) {
     Assert(label != NULL);
     *printed = '\0';
 }
 
-void Label::Print() {
-    printf("%s:\n", label);
+Label::~Label() {
+    free((char *)label);
+}
+
+void Label::Print(FILE *out) {
+    fprintf(out, "%s:\n", label);
 }
 
 void Label::EmitSpecific(Mips *mips) {
     mips->EmitLabel(label);
 }
 
+void Label::Save(TacWriter *w) {
+    w->Add(I_Label, w->String(label));
+}
+
 Goto::Goto(const char *l) : label(strdup(l)) {
     Assert(label != NULL);
     sprintf(printed, "Goto %s", label);
 }
 
+Goto::~Goto() {
+    free((char *)label);
+}
+
+void Goto::SetBranchLabel(const char *l) {
+    free((char *)label);
+    label = strdup(l);
+    sprintf(printed, "Goto %s", label);
+}
+
 void Goto::EmitSpecific(Mips *mips) {
     mips->EmitGoto(label);
 }
 
-IfZ::IfZ(Location *te, const char *l)
-  : test(te), label(strdup(l)) {
+void Goto::Save(TacWriter *w) {
+    w->Add(I_Goto, w->String(label));
+}
+
+IfZ::IfZ(Location *te, const char *l, bool nz)
+  : test(te), label(strdup(l)), nonZero(nz) {
     Assert(test != NULL && label != NULL);
-    sprintf(printed, "IfZ %s Goto %s", test->GetName(), label);
+    sprintf(printed, "%s %s Goto %s", nonZero ? "IfNZ" : "IfZ",
+            test->GetName(), label);
+}
+
+IfZ::~IfZ() {
+    free((char *)label);
+}
+
+void IfZ::SetBranchLabel(const char *l) {
+    free((char *)label);
+    label = strdup(l);
+    sprintf(printed, "%s %s Goto %s", nonZero ? "IfNZ" : "IfZ",
+            test->GetName(), label);
+}
+
+void IfZ::Negate() {
+    nonZero = !nonZero;
+    sprintf(printed, "%s %s Goto %s", nonZero ? "IfNZ" : "IfZ",
+            test->GetName(), label);
 }
 
 void IfZ::EmitSpecific(Mips *mips) {
-    mips->EmitIfZ(test, label);
+    mips->EmitIfZ(test, label, nonZero);
+}
+
+void IfZ::Save(TacWriter *w) {
+    w->Add(I_IfZ, w->Loc(test), w->String(label), nonZero);
+}
+
+void IfZ::SetUses(Location **uses) {
+    test = uses[0];
+    sprintf(printed, "%s %s Goto %s", nonZero ? "IfNZ" : "IfZ",
+            test->GetName(), label);
 }
 
 BeginFunc::BeginFunc() {
     sprintf(printed,"BeginFunc (unassigned)");
     frameSize = -555; 
+    paramSize = 0;
 }
 
 void BeginFunc::SetFrameSize(int numBytesForAllLocalsAndTemps) {
@@ -169,7 +287,11 @@ void BeginFunc::SetFrameSize(int numBytesForAllLocalsAndTemps) {
 }
 
 void BeginFunc::EmitSpecific(Mips *mips) {
-    mips->EmitBeginFunction(frameSize);
+    mips->EmitBeginFunction(frameSize, paramSize);
+}
+
+void BeginFunc::Save(TacWriter *w) {
+    w->Add(I_BeginFunc, frameSize, paramSize);
 }
 
 EndFunc::EndFunc() : Instruction() {
@@ -180,6 +302,10 @@ void EndFunc::EmitSpecific(Mips *mips) {
     mips->EmitEndFunction();
 }
 
+void EndFunc::Save(TacWriter *w) {
+    w->Add(I_EndFunc);
+}
+
 Return::Return(Location *v) : val(v) {
     sprintf(printed, "Return %s", val? val->GetName() : "");
 }
@@ -188,6 +314,14 @@ void Return::EmitSpecific(Mips *mips) {
     mips->EmitReturn(val);
 }
 
+void Return::Save(TacWriter *w) {
+    w->Add(I_Return, w->Loc(val));
+}
+
+void Return::SetUses(Location **uses) {
+    if (val) *this = Return(uses[0]);
+}
+
 PushParam::PushParam(Location *p)
   : param(p) {
     Assert(param != NULL);
@@ -198,6 +332,14 @@ void PushParam::EmitSpecific(Mips *mips) {
     mips->EmitParam(param);
 }
 
+void PushParam::Save(TacWriter *w) {
+    w->Add(I_PushParam, w->Loc(param));
+}
+
+void PushParam::SetUses(Location **uses) {
+    *this = PushParam(uses[0]);
+}
+
 PopParams::PopParams(int nb)
   : numBytes(nb) {
     sprintf(printed, "PopParams %d", numBytes);
@@ -207,18 +349,30 @@ void PopParams::EmitSpecific(Mips *mips) {
     mips->EmitPopParams(numBytes);
 }
 
-LCall::LCall(const char *l, Location *d)
-  : label(strdup(l)), dst(d) {
+void PopParams::Save(TacWriter *w) {
+    w->Add(I_PopParams, numBytes);
+}
+
+LCall::LCall(const char *l, Location *d, int e)
+  : label(strdup(l)), dst(d), effects(e) {
     sprintf(printed, "%s%sLCall %s", dst? dst->GetName(): "", dst?" = ":"",
             label);
 }
 
+LCall::~LCall() {
+    free((char *)label);
+}
+
 void LCall::EmitSpecific(Mips *mips) {
     mips->EmitLCall(dst, label);
 }
 
-ACall::ACall(Location *ma, Location *d)
-  : dst(d), methodAddr(ma) {
+void LCall::Save(TacWriter *w) {
+    w->Add(I_LCall, w->String(label), w->Loc(dst), effects);
+}
+
+ACall::ACall(Location *ma, Location *d, int e)
+  : dst(d), methodAddr(ma), effects(e) {
     Assert(methodAddr != NULL);
     sprintf(printed, "%s%sACall %s", dst? dst->GetName(): "", dst?" = ":"",
             methodAddr->GetName());
@@ -227,20 +381,56 @@ void ACall::EmitSpecific(Mips *mips) {
     mips->EmitACall(dst, methodAddr);
 }
 
-VTable::VTable(const char *l, List<const char *> *m)
-  : methodLabels(m), label(strdup(l)) {
-    Assert(methodLabels != NULL && label != NULL);
+void ACall::Save(TacWriter *w) {
+    w->Add(I_ACall, w->Loc(methodAddr), w->Loc(dst), effects);
+}
+
+void ACall::SetUses(Location **uses) {
+    *this = ACall(uses[0], dst, effects);
+}
+
+VTable::VTable(const char *l, List<const char *> *m, List<int> *r)
+  : methodLabels(m), refOffsets(r), label(strdup(l)) {
+    Assert(methodLabels != NULL && refOffsets != NULL && label != NULL);
     sprintf(printed, "VTable for class %s", l);
 }
 
-void VTable::Print() {
-    printf("VTable %s =\n", label);
+VTable::~VTable() {
+    free((char *)label);
+    delete methodLabels;
+    delete refOffsets;
+}
+
+void VTable::Print(FILE *out) {
+    fprintf(out, "VTable %s =\n", label);
     for (int i = 0; i < methodLabels->NumElements(); i++)
-        printf("\t%s,\n", methodLabels->Nth(i));
-    printf("; \n");
+        fprintf(out, "\t%s,\n", methodLabels->Nth(i));
+    fprintf(out, "; \n");
 }
 
 void VTable::EmitSpecific(Mips *mips) {
-    mips->EmitVTable(label, methodLabels);
+    mips->EmitVTable(label, methodLabels, refOffsets);
+}
+
+void VTable::Save(TacWriter *w) {
+    w->Add(I_VTable, w->String(label), w->Labels(methodLabels),
+           methodLabels->NumElements(), w->Words(refOffsets));
+}
+
+MemoTable::MemoTable(const char *l, int n, int bytes)
+  : label(strdup(l)), slots(n), entryBytes(bytes) {
+    Assert(label != NULL && slots > 0 && entryBytes >= 0);
+    sprintf(printed, "MemoTable for %s %d x %d", label, slots, entryBytes);
 }
 
+MemoTable::~MemoTable() {
+    free((char *)label);
+}
+
+void MemoTable::EmitSpecific(Mips *mips) {
+    mips->EmitMemoTable(label, slots, entryBytes);
+}
+
+void MemoTable::Save(TacWriter *w) {
+    w->Add(I_MemoTable, w->String(label), slots, entryBytes);
+}
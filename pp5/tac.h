@@ -6,6 +6,7 @@
 #include "list.h" 
 
 class Mips;
+class TacWriter;
 
 
 
@@ -17,6 +18,25 @@ class Mips;
 
 typedef enum {fpRelative, gpRelative} Segment;
 
+
+
+
+
+typedef enum {NotRef, HeapRef, DerivedRef} RefKind;
+
+typedef enum {
+    EF_ReadsGlobals = 1, EF_WritesGlobals = 2, EF_ReadsMemory = 4,
+    EF_WritesMemory = 8, EF_Allocates = 16, EF_IO = 32, EF_Halts = 64,
+    EF_All = 127
+} Effect;
+
+typedef enum {
+    I_LoadConstant, I_LoadStringConstant, I_LoadLabel, I_Assign, I_Load,
+    I_Store, I_BinaryOp, I_Label, I_Goto, I_IfZ, I_BeginFunc, I_EndFunc,
+    I_Return, I_PushParam, I_PopParams, I_LCall, I_ACall, I_VTable,
+    I_MemoTable, NumInstrKinds
+} instrT;
+
 class Location
 {
   protected:
@@ -24,15 +44,19 @@ class Location
     Segment segment;
     int offset;
     Location* base;
+    RefKind refKind;
 
   public:
     Location(Segment seg, int offset, const char *name);
     Location(Segment seg, int offset, const char *name, Location *base);
+    ~Location();
 
     const char *GetName() const     { return variableName; }
     Segment GetSegment() const      { return segment; }
     int GetOffset() const           { return offset; }
     Location* GetBase() const       { return base; }
+    RefKind GetRefKind() const      { return refKind; }
+    void SetRefKind(RefKind k)      { refKind = k; }
 
     void Print();
 };
@@ -45,9 +69,23 @@ class Instruction {
     char printed[128];
 
   public:
-    virtual void Print();
+    static const char * const kindName[NumInstrKinds];
+
+    virtual ~Instruction() {}
+    virtual instrT GetKind() = 0;
+    virtual void Print(FILE *out);
     virtual void EmitSpecific(Mips *mips) = 0;
     void Emit(Mips *mips);
+    virtual void Save(TacWriter *w) = 0;
+
+    static const int MaxUses = 2;
+    virtual Location *GetDst() { return NULL; }
+    virtual int GetUses(Location **uses) { return 0; }
+    virtual void SetUses(Location **uses) {}
+
+
+
+    virtual int GetEffects() { return 0; }
 };
 
 
@@ -71,6 +109,7 @@ class PopParams;
 class LCall;
 class ACall;
 class VTable;
+class MemoTable;
 
 class LoadConstant: public Instruction
 {
@@ -78,7 +117,11 @@ class LoadConstant: public Instruction
     int val;
   public:
     LoadConstant(Location *dst, int val);
+    instrT GetKind() { return I_LoadConstant; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    int GetValue() { return val; }
 };
 
 class LoadStringConstant: public Instruction
@@ -86,8 +129,12 @@ class LoadStringConstant: public Instruction
     Location *dst;
     char *str;
   public:
-    LoadStringConstant(Location *dst, const char *s);
+    LoadStringConstant(Location *dst, const char *s, int len);
+    ~LoadStringConstant();
+    instrT GetKind() { return I_LoadStringConstant; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
 };
 
 class LoadLabel: public Instruction
@@ -96,7 +143,12 @@ class LoadLabel: public Instruction
     const char *label;
   public:
     LoadLabel(Location *dst, const char *label);
+    ~LoadLabel();
+    instrT GetKind() { return I_LoadLabel; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    const char *GetLabel() { return label; }
 };
 
 class Assign: public Instruction
@@ -104,7 +156,12 @@ class Assign: public Instruction
     Location *dst, *src;
   public:
     Assign(Location *dst, Location *src);
+    instrT GetKind() { return I_Assign; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    int GetUses(Location **uses) { uses[0] = src; return 1; }
+    void SetUses(Location **uses);
 };
 
 class Load: public Instruction
@@ -113,7 +170,13 @@ class Load: public Instruction
     int offset;
   public:
     Load(Location *dst, Location *src, int offset = 0);
+    instrT GetKind() { return I_Load; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    int GetUses(Location **uses) { uses[0] = src; return 1; }
+    int GetOffset() { return offset; }
+    void SetUses(Location **uses);
 };
 
 class Store: public Instruction
@@ -122,7 +185,12 @@ class Store: public Instruction
     int offset;
   public:
     Store(Location *d, Location *s, int offset = 0);
+    instrT GetKind() { return I_Store; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    int GetUses(Location **uses) { uses[0] = dst; uses[1] = src; return 2; }
+    int GetOffset() { return offset; }
+    void SetUses(Location **uses);
 };
 
 class BinaryOp: public Instruction
@@ -142,7 +210,13 @@ class BinaryOp: public Instruction
     Location *dst, *op1, *op2;
   public:
     BinaryOp(OpCode c, Location *dst, Location *op1, Location *op2);
+    instrT GetKind() { return I_BinaryOp; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    OpCode GetOpCode() { return code; }
+    Location *GetDst() { return dst; }
+    int GetUses(Location **uses) { uses[0] = op1; uses[1] = op2; return 2; }
+    void SetUses(Location **uses);
 };
 
 class Label: public Instruction
@@ -150,8 +224,11 @@ class Label: public Instruction
     const char *label;
   public:
     Label(const char *label);
-    void Print();
+    ~Label();
+    void Print(FILE *out);
+    instrT GetKind() { return I_Label; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
     const char* text() const { return label; }
 };
 
@@ -160,35 +237,55 @@ class Goto: public Instruction
     const char *label;
   public:
     Goto(const char *label);
+    ~Goto();
+    instrT GetKind() { return I_Goto; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
     const char* branch_label() const { return label; }
+    void SetBranchLabel(const char *l);
 };
 
 class IfZ: public Instruction
 {
     Location *test;
     const char *label;
+    bool nonZero;
   public:
-    IfZ(Location *test, const char *label);
+    IfZ(Location *test, const char *label, bool nonZero = false);
+    ~IfZ();
+    instrT GetKind() { return I_IfZ; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
     const char* branch_label() const { return label; }
+    void SetBranchLabel(const char *l);
+    bool IsNonZero() const { return nonZero; }
+    void Negate();
+    int GetUses(Location **uses) { uses[0] = test; return 1; }
+    void SetUses(Location **uses);
 };
 
 class BeginFunc: public Instruction
 {
-    int frameSize;
+    int frameSize, paramSize;
   public:
     BeginFunc();
     
     void SetFrameSize(int numBytesForAllLocalsAndTemps);
+    void SetParamSize(int numBytesOfParams) { paramSize = numBytesOfParams; }
+    int GetFrameSize() { return frameSize; }
+    int GetParamSize() { return paramSize; }
+    instrT GetKind() { return I_BeginFunc; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
 };
 
 class EndFunc: public Instruction
 {
   public:
     EndFunc();
+    instrT GetKind() { return I_EndFunc; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
 };
 
 class Return: public Instruction
@@ -196,7 +293,11 @@ class Return: public Instruction
     Location *val;
   public:
     Return(Location *val);
+    instrT GetKind() { return I_Return; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    int GetUses(Location **uses) { uses[0] = val; return val != NULL; }
+    void SetUses(Location **uses);
 };
 
 class PushParam: public Instruction
@@ -204,7 +305,11 @@ class PushParam: public Instruction
     Location *param;
   public:
     PushParam(Location *param);
+    instrT GetKind() { return I_PushParam; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    int GetUses(Location **uses) { uses[0] = param; return 1; }
+    void SetUses(Location **uses);
 };
 
 class PopParams: public Instruction
@@ -212,34 +317,73 @@ class PopParams: public Instruction
     int numBytes;
   public:
     PopParams(int numBytesOfParamsToRemove);
+    instrT GetKind() { return I_PopParams; }
+    int GetNumBytes() { return numBytes; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
 };
 
 class LCall: public Instruction
 {
     const char *label;
     Location *dst;
+    int effects;
   public:
-    LCall(const char *labe, Location *result);
+    LCall(const char *labe, Location *result, int effects = EF_All);
+    ~LCall();
+    instrT GetKind() { return I_LCall; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    const char *GetLabel() { return label; }
+    int GetEffects() { return effects; }
 };
 
 class ACall: public Instruction
 {
     Location *dst, *methodAddr;
+    int effects;
   public:
-    ACall(Location *meth, Location *result);
+    ACall(Location *meth, Location *result, int effects = EF_All);
+    instrT GetKind() { return I_ACall; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+    Location *GetDst() { return dst; }
+    int GetUses(Location **uses) { uses[0] = methodAddr; return 1; }
+    void SetUses(Location **uses);
+    int GetEffects() { return effects; }
 };
 
 class VTable: public Instruction
 {
     List<const char *> *methodLabels;
+    List<int> *refOffsets;
     const char *label;
  public:
-    VTable(const char *labelForTable, List<const char *> *methodLabels);
-    void Print();
+    VTable(const char *labelForTable, List<const char *> *methodLabels,
+           List<int> *refOffsets);
+    ~VTable();
+    void Print(FILE *out);
+    instrT GetKind() { return I_VTable; }
+    void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
+};
+
+
+
+
+
+class MemoTable: public Instruction
+{
+    const char *label;
+    int slots, entryBytes;
+ public:
+    MemoTable(const char *labelForFn, int slots, int entryBytes);
+    ~MemoTable();
+    instrT GetKind() { return I_MemoTable; }
+    const char *GetLabel() { return label; }
     void EmitSpecific(Mips *mips);
+    void Save(TacWriter *w);
 };
 
 #endif
@@ -0,0 +1,368 @@
+
+
+#include "tacfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "codegen.h"
+#include "context.h"
+#include "errors.h"
+#include "mips.h"
+#include "optimizer.h"
+#include "scanner.h"
+
+TacWriter::TacWriter() {
+    strings.push_back('\0');
+}
+
+void TacWriter::BeginUnit(int unit) {
+    TacUnitRecord u = { unit, (int32_t)records.size(), 0 };
+    units.push_back(u);
+}
+
+void TacWriter::Add(instrT kind, int a, int b, int c, int d) {
+    Assert(!units.empty());
+    TacRecord r = { kind, a, b, c, d };
+    records.push_back(r);
+    units.back().count++;
+}
+
+int TacWriter::String(const char *s) {
+    auto it = stringIndex.find(s);
+    if (it != stringIndex.end()) return it->second;
+    int offset = strings.size();
+    strings.append(s, strlen(s) + 1);
+    stringIndex[s] = offset;
+    return offset;
+}
+
+int TacWriter::Loc(Location *l) {
+    if (!l) return -1;
+    int base = Loc(l->GetBase());
+    TacLocationRecord r = { String(l->GetName()), l->GetSegment(),
+                            l->GetOffset(), base, l->GetRefKind() };
+
+    std::string key((const char *)&r, sizeof r);
+    auto it = locationIndex.find(key);
+    if (it != locationIndex.end()) return it->second;
+    locations.push_back(r);
+    return locationIndex[key] = locations.size() - 1;
+}
+
+int TacWriter::Labels(List<const char*> *list) {
+    int first = labels.size();
+    for (int i = 0; i < list->NumElements(); i++)
+        labels.push_back(String(list->Nth(i)));
+    return first;
+}
+
+int TacWriter::Words(List<int> *list) {
+    int first = labels.size();
+    labels.push_back(list->NumElements());
+    for (int i = 0; i < list->NumElements(); i++)
+        labels.push_back(list->Nth(i));
+    return first;
+}
+
+template <class T>
+static void Append(std::string *buf, const std::vector<T> &table) {
+    buf->append((const char *)table.data(), table.size() * sizeof(T));
+}
+
+bool TacWriter::WriteTo(const char *fileName) {
+    TacFileHeader h;
+    memcpy(h.magic, TacMagic, sizeof h.magic);
+    h.version = TacVersion;
+    h.numUnits = units.size();
+    h.numLocations = locations.size();
+    h.numRecords = records.size();
+    h.numLabels = labels.size();
+    h.unitsOffset = sizeof h;
+    h.locationsOffset = h.unitsOffset + units.size() * sizeof(TacUnitRecord);
+    h.recordsOffset = h.locationsOffset
+                    + locations.size() * sizeof(TacLocationRecord);
+    h.labelsOffset = h.recordsOffset + records.size() * sizeof(TacRecord);
+    h.stringsOffset = h.labelsOffset + labels.size() * sizeof(int32_t);
+    h.stringsSize = strings.size();
+
+    std::string buf((const char *)&h, sizeof h);
+    buf.reserve(h.stringsOffset + h.stringsSize);
+    Append(&buf, units);
+    Append(&buf, locations);
+    Append(&buf, records);
+    Append(&buf, labels);
+    buf += strings;
+
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return false;
+    const char *p = buf.data();
+    size_t left = buf.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= n;
+    }
+    return close(fd) == 0 && left == 0;
+}
+
+TacImage::TacImage() {
+    base = NULL;
+    size = 0;
+    header = NULL;
+}
+
+TacImage::~TacImage() {
+    for (int i = 0; i < locations.size(); i++)
+        delete locations[i];
+    if (base) munmap(base, size);
+}
+
+bool TacImage::Open(const char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TacFileHeader)) {
+        close(fd);
+        return false;
+    }
+    size = st.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    base = (char *)p;
+
+    header = (const TacFileHeader *)base;
+    units = (const TacUnitRecord *)(base + header->unitsOffset);
+    locationRecords =
+        (const TacLocationRecord *)(base + header->locationsOffset);
+    records = (const TacRecord *)(base + header->recordsOffset);
+    labels = (const int32_t *)(base + header->labelsOffset);
+    strings = base + header->stringsOffset;
+    if (!Validate()) return false;
+
+    locations.assign(header->numLocations, NULL);
+    return true;
+}
+
+
+
+
+
+
+static const char *const operandKinds[NumInstrKinds] = {
+    "LI--", "LQ--", "LS--", "LL--", "LLI-",
+    "LLI-", "OLLL", "S---", "S---", "LSB-", "FF--", "----",
+    "l---", "L---", "I---", "SlE-", "LlE-", "SVIW", "SNF-"
+};
+
+static const size_t MaxNameLen = MaxIdentLen + 8;
+static const size_t MaxLabelLen = 2 * MaxIdentLen + 8;
+static const size_t MaxConstantLen = 512;
+static const int32_t MaxTableSlots = 1 << 16;
+
+static bool InTable(const TacFileHeader *h, size_t size, uint32_t offset,
+                    uint64_t count, size_t elem) {
+    return offset % 4 == 0 && offset >= sizeof *h
+        && offset + count * elem <= size;
+}
+
+bool TacImage::Validate() {
+    const TacFileHeader *h = header;
+    if (memcmp(h->magic, TacMagic, sizeof h->magic) != 0
+        || h->version != TacVersion)
+        return false;
+    if (!InTable(h, size, h->unitsOffset, h->numUnits, sizeof *units)
+        || !InTable(h, size, h->locationsOffset, h->numLocations,
+                    sizeof *locationRecords)
+        || !InTable(h, size, h->recordsOffset, h->numRecords, sizeof *records)
+        || !InTable(h, size, h->labelsOffset, h->numLabels, sizeof *labels)
+        || (uint64_t)h->stringsOffset + h->stringsSize > size
+        || h->stringsSize == 0 || strings[h->stringsSize - 1] != '\0')
+        return false;
+
+    const char *strings = this->strings;
+    auto isString = [h, strings](int32_t s, size_t maxLen) {
+        return s >= 0 && (uint32_t)s < h->stringsSize
+            && strnlen(strings + s, maxLen + 1) <= maxLen;
+    };
+    auto isLoc = [h](int32_t l) {
+        return l >= 0 && (uint32_t)l < h->numLocations;
+    };
+
+    for (uint32_t i = 0; i < h->numLocations; i++) {
+        const TacLocationRecord &l = locationRecords[i];
+        if (!isString(l.name, MaxNameLen) || l.offset % 4 != 0
+            || (l.segment != fpRelative && l.segment != gpRelative)
+            || l.ref < NotRef || l.ref > DerivedRef
+            || l.base < -1 || l.base >= (int32_t)i)
+            return false;
+    }
+    for (uint32_t i = 0; i < h->numUnits; i++) {
+        const TacUnitRecord &u = units[i];
+        if (u.first < 0 || u.count < 0
+            || (uint64_t)u.first + u.count > h->numRecords)
+            return false;
+    }
+    for (uint32_t i = 0; i < h->numRecords; i++) {
+        const TacRecord &r = records[i];
+        if (r.kind < 0 || r.kind >= NumInstrKinds) return false;
+        const int32_t operand[4] = { r.a, r.b, r.c, r.d };
+        for (int k = 0; k < 4; k++) {
+            int32_t v = operand[k];
+            switch (operandKinds[r.kind][k]) {
+              case 'L': if (!isLoc(v)) return false; break;
+              case 'l': if (v != -1 && !isLoc(v)) return false; break;
+              case 'S': if (!isString(v, MaxLabelLen)) return false; break;
+              case 'Q': if (!isString(v, MaxConstantLen)) return false; break;
+              case 'F': if (v < 0 || v % 4 != 0) return false; break;
+              case 'B': if (v != 0 && v != 1) return false; break;
+              case 'E': if (v & ~EF_All) return false; break;
+              case 'N': if (v <= 0 || v > MaxTableSlots) return false; break;
+              case 'O':
+                if (v < 0 || v >= BinaryOp::NumOps) return false;
+                break;
+              case 'V':
+                if (v < 0 || operand[k+1] < 0
+                    || (uint64_t)v + operand[k+1] > h->numLabels)
+                    return false;
+                for (int32_t j = 0; j < operand[k+1]; j++)
+                    if (!isString(labels[v + j], MaxLabelLen)) return false;
+                break;
+              case 'W':
+                if (v < 0 || (uint32_t)v >= h->numLabels || labels[v] < 0
+                    || (uint64_t)v + 1 + labels[v] > h->numLabels)
+                    return false;
+                for (int32_t j = 1; j <= labels[v]; j++)
+                    if (labels[v + j] <= 0 || labels[v + j] % 4 != 0)
+                        return false;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+const char *TacImage::String(int32_t offset) {
+    return strings + offset;
+}
+
+Location *TacImage::Loc(int32_t index) {
+    if (index < 0) return NULL;
+    if (!locations[index]) {
+        const TacLocationRecord &r = locationRecords[index];
+        locations[index] = new Location((Segment)r.segment, r.offset,
+                                        String(r.name), Loc(r.base));
+        locations[index]->SetRefKind((RefKind)r.ref);
+    }
+    return locations[index];
+}
+
+Instruction *TacImage::Build(const TacRecord &r) {
+    switch (r.kind) {
+      case I_LoadConstant: return new LoadConstant(Loc(r.a), r.b);
+      case I_LoadStringConstant: {
+        const char *s = String(r.b);
+        return new LoadStringConstant(Loc(r.a), s, strlen(s));
+      }
+      case I_LoadLabel:    return new LoadLabel(Loc(r.a), String(r.b));
+      case I_Assign:       return new Assign(Loc(r.a), Loc(r.b));
+      case I_Load:         return new Load(Loc(r.a), Loc(r.b), r.c);
+      case I_Store:        return new Store(Loc(r.a), Loc(r.b), r.c);
+      case I_BinaryOp:
+        return new BinaryOp((BinaryOp::OpCode)r.a, Loc(r.b), Loc(r.c),
+                            Loc(r.d));
+      case I_Label:        return new Label(String(r.a));
+      case I_Goto:         return new Goto(String(r.a));
+      case I_IfZ:          return new IfZ(Loc(r.a), String(r.b), r.c);
+      case I_BeginFunc: {
+        BeginFunc *f = new BeginFunc();
+        f->SetFrameSize(r.a);
+        f->SetParamSize(r.b);
+        return f;
+      }
+      case I_EndFunc:      return new EndFunc();
+      case I_Return:       return new Return(Loc(r.a));
+      case I_PushParam:    return new PushParam(Loc(r.a));
+      case I_PopParams:    return new PopParams(r.a);
+      case I_LCall:        return new LCall(String(r.a), Loc(r.b), r.c);
+      case I_ACall:        return new ACall(Loc(r.a), Loc(r.b), r.c);
+      case I_VTable: {
+        List<const char*> *methods = new List<const char*>;
+        for (int32_t j = 0; j < r.c; j++)
+            methods->Append(String(labels[r.b + j]));
+        List<int> *refs = new List<int>;
+        for (int32_t j = 1; j <= labels[r.d]; j++)
+            refs->Append(labels[r.d + j]);
+        return new VTable(String(r.a), methods, refs);
+      }
+      case I_MemoTable:    return new MemoTable(String(r.a), r.b, r.c);
+    }
+    return NULL;
+}
+
+void TacImage::GlobalRoots(std::vector<int> *offsets) {
+    for (uint32_t i = 0; i < header->numLocations; i++) {
+        const TacLocationRecord &r = locationRecords[i];
+        if (r.segment == gpRelative && r.ref == HeapRef)
+            offsets->push_back(r.offset);
+    }
+}
+
+void TacImage::MemoTables(std::vector<std::string> *labels) {
+    for (uint32_t i = 0; i < header->numRecords; i++)
+        if (records[i].kind == I_MemoTable)
+            labels->push_back(String(records[i].a));
+}
+
+CodeGenerator *TacImage::Unit(int i) {
+    const TacUnitRecord &u = units[i];
+    CodeGenerator *cg = new CodeGenerator(u.unit);
+    for (int32_t j = 0; j < u.count; j++)
+        cg->Append(Build(records[u.first + j]));
+    return cg;
+}
+
+bool EmitTacFile(const char *fileName) {
+    CompilationContext ctx;
+    CompilationContext::Use use(&ctx);
+    TacImage image;
+    if (!image.Open(fileName)) {
+        ReportError::Formatted(NULL, "Unable to load TAC from '%s'",
+                               fileName);
+        return false;
+    }
+
+    bool tac = IsDebugOn("tac");
+    if (!tac) {
+        Mips mips;
+        mips.EmitPreamble();
+    }
+    PassManager *passes = PassManager::ForContext();
+    for (int i = 0; i < image.NumUnits(); i++) {
+        CodeGenerator *cg = image.Unit(i);
+        if (passes) passes->Run(cg);
+        if (tac)
+            cg->PrintTac(ctx.out);
+        else
+            cg->EmitMips(NULL);
+        delete cg;
+    }
+    if (!tac) {
+        std::vector<int> roots;
+        std::vector<std::string> memos;
+        image.GlobalRoots(&roots);
+        image.MemoTables(&memos);
+        Mips mips;
+        mips.EmitGlobalRoots(roots, memos);
+    }
+    if (passes && IsDebugOn("passes"))
+        passes->PrintReport(stderr);
+    delete passes;
+    fflush(ctx.out);
+    return ctx.numErrors == 0;
+}
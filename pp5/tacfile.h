@@ -0,0 +1,118 @@
+
+
+#ifndef _H_tacfile
+#define _H_tacfile
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "list.h"
+#include "tac.h"
+
+class CodeGenerator;
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+static const char TacMagic[4] = { 'D', 'T', 'A', 'C' };
+static const uint32_t TacVersion = 6;
+
+struct TacFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numUnits, numLocations, numRecords, numLabels;
+    uint32_t unitsOffset, locationsOffset, recordsOffset, labelsOffset;
+    uint32_t stringsOffset, stringsSize;
+};
+
+struct TacUnitRecord {
+    int32_t unit, first, count;
+};
+
+struct TacLocationRecord {
+    int32_t name, segment, offset, base, ref;
+};
+
+
+
+
+struct TacRecord {
+    int32_t kind, a, b, c, d;
+};
+
+
+
+
+class TacWriter
+{
+  public:
+    TacWriter();
+
+    void BeginUnit(int unit);
+    void Add(instrT kind, int a = 0, int b = 0, int c = 0, int d = 0);
+    int String(const char *s);
+    int Loc(Location *l);
+    int Labels(List<const char*> *labels);
+    int Words(List<int> *words);
+
+    bool WriteTo(const char *fileName);
+
+  private:
+    std::vector<TacUnitRecord> units;
+    std::vector<TacLocationRecord> locations;
+    std::vector<TacRecord> records;
+    std::vector<int32_t> labels;
+    std::string strings;
+    std::unordered_map<std::string, int> stringIndex;
+    std::unordered_map<std::string, int> locationIndex;
+};
+
+
+
+
+class TacImage
+{
+  public:
+    TacImage();
+    ~TacImage();
+
+    bool Open(const char *fileName);
+
+    int NumUnits() { return header->numUnits; }
+    CodeGenerator *Unit(int i);
+    void GlobalRoots(std::vector<int> *offsets);
+    void MemoTables(std::vector<std::string> *labels);
+
+  private:
+    char *base;
+    size_t size;
+    const TacFileHeader *header;
+    const TacUnitRecord *units;
+    const TacLocationRecord *locationRecords;
+    const TacRecord *records;
+    const int32_t *labels;
+    const char *strings;
+    std::vector<Location*> locations;
+
+    bool Validate();
+    const char *String(int32_t offset);
+    Location *Loc(int32_t index);
+    Instruction *Build(const TacRecord &r);
+};
+
+
+
+bool EmitTacFile(const char *fileName);
+
+#endif
@@ -0,0 +1,148 @@
+
+
+#include "tailcall.h"
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+#include "codegen.h"
+
+typedef std::list<Instruction*>::iterator Iter;
+
+typedef std::pair<Location*, Location*> Move;
+
+static bool IsParam(Location *l) {
+    return l->GetSegment() == fpRelative
+        && l->GetOffset() >= CodeGenerator::OffsetToFirstParam;
+}
+
+static bool SameSlot(Location *a, Location *b) {
+    return a->GetSegment() == b->GetSegment()
+        && a->GetOffset() == b->GetOffset();
+}
+
+class SelfTailCalls
+{
+  public:
+    SelfTailCalls(CodeGenerator *cg)
+      : cg(cg), code(cg->GetCode()), begin(NULL), top(NULL), scratch(NULL) {}
+
+    bool Run();
+
+  private:
+    CodeGenerator *cg;
+    std::list<Instruction*> *code;
+    BeginFunc *begin;
+    char *top;
+    Location *scratch;
+    std::map<int, Location*> params;
+
+    bool Rewrite(Iter call, const char *self);
+    void Sequence(std::vector<Move> moves, Iter at);
+};
+
+
+
+
+
+bool SelfTailCalls::Rewrite(Iter call, const char *self) {
+    LCall *lcall = dynamic_cast<LCall*>(*call);
+    if (strcmp(lcall->GetLabel(), self)) return false;
+    Iter p = std::next(call);
+    if (p != code->end() && (*p)->GetKind() == I_PopParams) ++p;
+    if (p == code->end()) return false;
+    Location *value = NULL;
+    if ((*p)->GetKind() == I_Return) {
+        if ((*p)->GetUses(&value) && value != lcall->GetDst()) return false;
+    } else if ((*p)->GetKind() != I_EndFunc) {
+        return false;
+    }
+    Iter last = (*p)->GetKind() == I_Return ? std::next(p) : p;
+
+    int numArgs = begin->GetParamSize() / CodeGenerator::VarSize;
+    std::vector<Move> moves;
+    Iter first = call;
+    for (int k = 0; k < numArgs; k++) {
+        if (first == code->begin()
+            || (*std::prev(first))->GetKind() != I_PushParam)
+            return false;
+        --first;
+        Location *arg;
+        (*first)->GetUses(&arg);
+        int offset = CodeGenerator::OffsetToFirstParam
+                   + k * CodeGenerator::VarSize;
+        auto it = params.find(offset);
+        if (it != params.end() && !SameSlot(it->second, arg))
+            moves.push_back(Move(it->second, arg));
+    }
+
+    if (!top) {
+        top = cg->NewLabel();
+        Iter entry = code->begin();
+        while ((*entry)->GetKind() != I_BeginFunc) ++entry;
+        code->insert(std::next(entry), new Label(top));
+    }
+    for (Iter q = first; q != last; ) {
+        delete *q;
+        q = code->erase(q);
+    }
+    Sequence(moves, last);
+    code->insert(last, new Goto(top));
+    return true;
+}
+
+void SelfTailCalls::Sequence(std::vector<Move> moves, Iter at) {
+    while (!moves.empty()) {
+        bool progress = false;
+        for (int i = 0; i < moves.size(); i++) {
+            bool read = false;
+            for (int j = 0; j < moves.size() && !read; j++)
+                read = j != i && SameSlot(moves[j].second, moves[i].first);
+            if (read) continue;
+            code->insert(at, new Assign(moves[i].first, moves[i].second));
+            moves.erase(moves.begin() + i);
+            progress = true;
+            break;
+        }
+        if (progress) continue;
+        if (!scratch) scratch = cg->NewFrameTemp(begin);
+        Location *blocked = moves[0].second;
+        scratch->SetRefKind(blocked->GetRefKind());
+        code->insert(at, new Assign(scratch, blocked));
+        for (int j = 0; j < moves.size(); j++)
+            if (SameSlot(moves[j].second, blocked)) moves[j].second = scratch;
+    }
+}
+
+bool SelfTailCalls::Run() {
+    Iter p = code->begin();
+    if (p == code->end() || (*p)->GetKind() != I_Label) return false;
+    const char *self = dynamic_cast<Label*>(*p)->text();
+    if (++p == code->end() || (*p)->GetKind() != I_BeginFunc) return false;
+    begin = dynamic_cast<BeginFunc*>(*p);
+
+    for (p = code->begin(); p != code->end(); ++p) {
+        Location *locs[Instruction::MaxUses + 1];
+        int n = (*p)->GetUses(locs);
+        if ((*p)->GetDst()) locs[n++] = (*p)->GetDst();
+        for (int k = 0; k < n; k++)
+            if (IsParam(locs[k])) params[locs[k]->GetOffset()] = locs[k];
+    }
+
+    bool changed = false;
+    for (p = code->begin(); p != code->end(); ) {
+        Iter call = p++;
+        if ((*call)->GetKind() == I_LCall && Rewrite(call, self)) {
+            changed = true;
+            p = code->begin();
+        }
+    }
+    free(top);
+    return changed;
+}
+
+bool TailRecursion::Run(CodeGenerator *cg) {
+    SelfTailCalls calls(cg);
+    return calls.Run();
+}
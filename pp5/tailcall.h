@@ -0,0 +1,25 @@
+
+
+#ifndef _H_tailcall
+#define _H_tailcall
+
+#include "optimizer.h"
+
+
+
+
+
+
+
+
+
+
+
+class TailRecursion: public Pass
+{
+  public:
+    const char *Name() { return "tail-recursion"; }
+    bool Run(CodeGenerator *cg);
+};
+
+#endif
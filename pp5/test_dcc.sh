@@ -1,4 +1,20 @@
-programas_decaf=($(ls samples | grep -oP '.*\.decaf' | grep -oP '.*\.'))
+# Compiles and runs every sample through "dcc --batch --run", which
+# spreads the files over all cores and compares each program's output
+# with its .out file (a sample's .in file, if there is one, is its
+# standard input). Mismatching outputs are left as .actual files in
+# the output folder and diffed into the difs folder. The samples are
+# run a second time at -O2 so the optimizer is held to the same outputs,
+# and a third time at -O2 with --memoize. The memo table counters that
+# "-d memostats" prints for samples/memo.decaf are checked against
+# samples/memo.stats.
+# The -O2 assembly is then compared with what the other ways of
+# producing it give: a second batch compile against a warm --cache-dir,
+# TAC saved at -O0 with --save-tac and loaded at -O2 with --load-tac,
+# and a compile through a "dcc --server" with "dcc --client".
+# Mismatches are diffed into the difs folder as <name>-cache.diff,
+# <name>-tac.diff and <name>-client.diff.
+# "./test_dcc.sh bench [loops]" also builds one very large function and
+# reports how long the dataflow analyses take on it (-d dataflow).
 
 output_folder=output_dcc
 difs_folder=difs
@@ -11,12 +27,89 @@ if [ ! -d $output_folder ]; then
 	mkdir $output_folder
 fi
 
-for i in "${programas_decaf[@]}"
+./dcc --batch --run --out-dir=$output_folder samples/*.decaf
+./dcc -O2 --batch --run --out-dir=$output_folder/O2 samples/*.decaf
+./dcc -O2 --memoize --batch --run --out-dir=$output_folder/memo samples/*.decaf
+
+for i in $output_folder/*.actual $output_folder/O2/*.actual $output_folder/memo/*.actual
+do
+   [ -f $i ] || continue
+   name=$(basename $i .actual)
+   suffix=$(basename $(dirname $i) | sed -n 's/^O/-O/p;s/^memo$/-memo/p')
+   (diff --text $i "samples/"$name".out") > $difs_folder/$name$suffix".diff"
+done
+
+./dcc -O2 --memoize -d memostats < samples/memo.decaf > $output_folder/memostats.asm
+cat defs.asm >> $output_folder/memostats.asm
+spim -file $output_folder/memostats.asm | grep "^memo " > $output_folder/memostats.txt
+if diff --text $output_folder/memostats.txt samples/memo.stats > $difs_folder/memostats.diff
+then
+   echo "memostats: passed"
+   rm $difs_folder/memostats.diff
+else
+   echo "memostats: failed"
+fi
+
+check() {
+   if cmp -s $2 $3
+   then
+      passed=$((passed + 1))
+   else
+      failed=$((failed + 1))
+      (diff --text $2 $3) > $difs_folder/$1".diff"
+   fi
+}
+
+./dcc -O2 --batch --out-dir=$output_folder/plain samples/*.decaf 2>/dev/null
+rm -rf $output_folder/cache
+./dcc -O2 --batch --cache-dir=$output_folder/cache --out-dir=$output_folder/cold samples/*.decaf 2>/dev/null
+./dcc -O2 --batch --cache-dir=$output_folder/cache --out-dir=$output_folder/warm samples/*.decaf 2>/dev/null
+passed=0; failed=0
+for i in $output_folder/plain/*.asm
 do
-   : 
-   echo $i"decaf"
-   (./run "samples/"$i"decaf") > $output_folder/$i"out1" 2>&1
-   tr < $output_folder/$i"out1" -d '\000' > $output_folder/$i"out"
-   (diff --text $output_folder/$i"out" "samples/"$i"out") > $difs_folder/$i"diff"
-   rm $output_folder/$i"out1"
+   name=$(basename $i .asm)
+   check $name-cache $i $output_folder/warm/$name.asm
 done
+echo "cache: $passed passed, $failed failed"
+
+passed=0; failed=0
+for i in $output_folder/plain/*.asm
+do
+   name=$(basename $i .asm)
+   ./dcc -O0 --save-tac=$output_folder/$name.tac < samples/$name.decaf > /dev/null
+   ./dcc -O2 --load-tac=$output_folder/$name.tac > $output_folder/$name-tac.asm
+   check $name-tac $i $output_folder/$name-tac.asm
+done
+echo "tac: $passed passed, $failed failed"
+
+socket=$output_folder/dcc.sock
+rm -f $socket
+./dcc --server=$socket 2>/dev/null &
+server=$!
+for t in $(seq 50); do [ -S $socket ] && break; sleep 0.1; done
+passed=0; failed=0
+for i in $output_folder/plain/*.asm
+do
+   name=$(basename $i .asm)
+   ./dcc -O2 --client=$socket < samples/$name.decaf > $output_folder/$name-client.asm
+   check $name-client $i $output_folder/$name-client.asm
+done
+echo "client: $passed passed, $failed failed ($(./dcc --client=$socket --server-stats))"
+kill $server
+rm -f $socket
+
+if [ "$1" = "bench" ]; then
+   loops=${2:-500}
+   {
+      echo "void main() {"
+      echo "   int a; int b; int c; int i;"
+      echo "   a = 1; b = 2; c = 3;"
+      for n in $(seq $loops); do
+         echo "   for (i = 0; i < 10; i = i + 1) { if (a > c) c = a - b; else b = b + i; a = a + b; }"
+      done
+      echo "   Print(a, b, c);"
+      echo "}"
+   } > $output_folder/bench.decaf
+   ./dcc -O1 -d dataflow < $output_folder/bench.decaf 2>&1 >/dev/null | grep "^dataflow"
+   rm $output_folder/bench.decaf
+fi
@@ -0,0 +1,35 @@
+# Compares the flex scanner with the hand-written one (--lexer=fast):
+# the token dump (-d tokens) and error output must be identical for
+# every sample. "./test_lexer.sh bench [copies]" also scans the samples
+# repeated many times with each lexer and reports their throughput.
+
+output_folder=output_lexer
+failed=0
+
+if [ ! -d $output_folder ]; then
+	mkdir $output_folder
+fi
+
+for i in samples/*.decaf interactive_samples/*.decaf
+do
+   [ -f $i ] || continue
+   name=$(basename $i .decaf)
+   ./dcc --lexer=flex -d tokens < $i > $output_folder/$name.flex 2>&1
+   ./dcc --lexer=fast -d tokens < $i > $output_folder/$name.fast 2>&1
+   if ! diff --text $output_folder/$name.flex $output_folder/$name.fast > $output_folder/$name.diff
+   then
+      echo "MISMATCH $i"
+      failed=1
+   fi
+done
+
+if [ "$1" = "bench" ]; then
+   copies=${2:-2000}
+   cat samples/*.decaf > $output_folder/one.decaf
+   for n in $(seq $copies); do cat $output_folder/one.decaf; done > $output_folder/bench.decaf
+   ./dcc --lexer=flex --scan-only < $output_folder/bench.decaf 2>&1 >/dev/null | tail -1
+   ./dcc --lexer=fast --scan-only < $output_folder/bench.decaf 2>&1 >/dev/null | tail -1
+   rm $output_folder/one.decaf $output_folder/bench.decaf
+fi
+
+exit $failed
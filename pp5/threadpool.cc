@@ -0,0 +1,111 @@
+
+
+#include "threadpool.h"
+#include <stdlib.h>
+#include "context.h"
+#include "utility.h"
+
+static thread_local ThreadPool *currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int numWorkers) {
+    Assert(numWorkers > 0);
+    queued = running = 0;
+    nextQueue = 0;
+    stopping = false;
+    for (int i = 0; i < numWorkers; i++)
+        queues.push_back(new Queue);
+    for (int i = 0; i < numWorkers; i++)
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> g(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (int i = 0; i < workers.size(); i++)
+        workers[i].join();
+    for (int i = 0; i < queues.size(); i++)
+        delete queues[i];
+}
+
+void ThreadPool::Submit(Task t) {
+    CompilationContext *ctx = CompilationContext::Current();
+    if (ctx) t = [ctx, t] { CompilationContext::Use use(ctx); t(); };
+
+    int q;
+    if (currentPool == this) {
+        q = currentWorker;
+    } else {
+        std::lock_guard<std::mutex> g(lock);
+        q = nextQueue++ % queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> g(queues[q]->lock);
+        queues[q]->tasks.push_back(t);
+    }
+    {
+        std::lock_guard<std::mutex> g(lock);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::WaitAll() {
+    std::unique_lock<std::mutex> g(lock);
+    idle.wait(g, [this] { return queued == 0 && running == 0; });
+}
+
+
+
+bool ThreadPool::TryTake(int id, Task &t) {
+    for (int i = 0; i < queues.size(); i++) {
+        Queue *q = queues[(id + i) % queues.size()];
+        std::lock_guard<std::mutex> g(q->lock);
+        if (q->tasks.empty()) continue;
+        if (i == 0) {
+            t = q->tasks.back();
+            q->tasks.pop_back();
+        } else {
+            t = q->tasks.front();
+            q->tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(int id) {
+    currentPool = this;
+    currentWorker = id;
+    for (;;) {
+        Task t;
+        if (TryTake(id, t)) {
+            {
+                std::lock_guard<std::mutex> g(lock);
+                queued--;
+                running++;
+            }
+            t();
+            {
+                std::lock_guard<std::mutex> g(lock);
+                running--;
+                if (queued == 0 && running == 0) idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> g(lock);
+        if (stopping) return;
+        if (queued == 0) wake.wait(g);
+    }
+}
+
+int ThreadPool::NumJobs() {
+    const char *jobs = GetOption("jobs");
+    if (!jobs) return 1;
+    int n = atoi(jobs);
+    if (n <= 0) n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
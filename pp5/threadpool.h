@@ -0,0 +1,55 @@
+
+
+#ifndef _H_threadpool
+#define _H_threadpool
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+class ThreadPool
+{
+  public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(int numWorkers);
+    ~ThreadPool();
+
+
+
+
+    void Submit(Task t);
+
+
+    void WaitAll();
+
+    int NumWorkers() { return workers.size(); }
+
+
+
+    static int NumJobs();
+
+  private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Queue*> queues;
+    std::mutex lock;
+    std::condition_variable wake, idle;
+    int queued, running;
+    unsigned nextQueue;
+    bool stopping;
+
+    void WorkerLoop(int id);
+    bool TryTake(int id, Task &t);
+};
+
+#endif
@@ -3,9 +3,14 @@
 #include "utility.h"
 #include <stdarg.h>
 #include "list.h"
+#include "hashtable.h"
+#include "context.h"
 #include <string.h>
 
 static List<const char*> debugKeys;
+static Hashtable<const char*> options;
+static List<const char*> optionKeys;
+static List<const char*> inputFiles;
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -13,29 +18,42 @@ void Failure(const char *format, ...) {
     char errbuf[BufferSize];
 
     va_start(args, format);
-    vsprintf(errbuf, format, args);
+    vsnprintf(errbuf, sizeof(errbuf), format, args);
     va_end(args);
     fflush(stdout);
     fprintf(stderr,"\n*** Failure: %s\n\n", errbuf);
     abort();
 }
 
-int IndexOf(const char *key) {
-    for (int i = 0; i < debugKeys.NumElements(); i++)
-        if (!strcmp(debugKeys.Nth(i), key)) return i;
+
+
+static List<const char*> *ActiveKeys() {
+    CompilationContext *ctx = CompilationContext::Current();
+    return ctx ? &ctx->debugKeys : &debugKeys;
+}
+
+int IndexOf(List<const char*> *keys, const char *key) {
+    for (int i = 0; i < keys->NumElements(); i++)
+        if (!strcmp(keys->Nth(i), key)) return i;
     return -1;
 }
 
 bool IsDebugOn(const char *key) {
-    return (IndexOf(key) != -1);
+    return (IndexOf(ActiveKeys(), key) != -1);
 }
 
 void SetDebugForKey(const char *key, bool value) {
-    int k = IndexOf(key);
+    List<const char*> *keys = ActiveKeys();
+    int k = IndexOf(keys, key);
     if (!value && k != -1)
-        debugKeys.RemoveAt(k);
+        keys->RemoveAt(k);
     else if (value && k == -1)
-        debugKeys.Append(key);
+        keys->Append(key);
+}
+
+void InheritDebugKeys(List<const char*> *keys) {
+    for (int i = 0; i < debugKeys.NumElements(); i++)
+        keys->Append(debugKeys.Nth(i));
 }
 
 void PrintDebug(const char *key, const char *format, ...) {
@@ -46,21 +64,89 @@ void PrintDebug(const char *key, const char *format, ...) {
         return;
 
     va_start(args, format);
-    vsprintf(buf, format, args);
+    vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
     printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
 }
 
+void SetOption(const char *key, const char *value) {
+    if (!options.Lookup(key)) optionKeys.Append(strdup(key));
+    options.Enter(key, strdup(value ? value : ""));
+}
+
+const char *GetOption(const char *key) {
+    return options.Lookup(key);
+}
+
+List<const char*> *GetOptionKeys() {
+    return &optionKeys;
+}
+
+List<const char*> *GetInputFiles() {
+    return &inputFiles;
+}
+
+static bool IsInputFile(const char *arg) {
+    const char *ext = strrchr(arg, '.');
+    return ext && !strcmp(ext, ".decaf");
+}
+
+static const char *knownOptions[] = {
+    "stats", "jobs", "stream", "lexer", "scan-only", "cache-dir", "save-tac",
+    "load-tac", "opt-bisect-limit", "memoize", "batch", "out-dir", "run",
+    "defs", "timeout", "server", "cache-size", "client", "server-stats"
+};
+
+static bool IsKnownOption(const char *key) {
+    int n = sizeof(knownOptions) / sizeof(knownOptions[0]);
+    for (int i = 0; i < n; i++)
+        if (!strcmp(key, knownOptions[i])) return true;
+    return false;
+}
+
+static void Usage() {
+    printf("Usage:   [--stats[=json]] [--jobs=N] [--stream] "
+           "[--lexer=flex|fast] [--scan-only] [--cache-dir=dir] "
+           "[--save-tac=file] [--load-tac=file] "
+           "[-O0|-O1|-O2] [--opt-bisect-limit=N] [--memoize] "
+           "[file.decaf ...] "
+           "[--batch[=list] [--out-dir=dir] [--run[=cmd]] "
+           "[--defs=file] [--timeout=secs]] "
+           "[--server[=socket] [--cache-size=MB]] "
+           "[--client[=socket]] [--server-stats] "
+           "-d <debug-key-1> <debug-key-2> ... \n");
+    exit(2);
+}
+
 void ParseCommandLine(int argc, char *argv[]) {
-    if (argc == 1)
-        return;
+    bool debugKeysFollow = false;
 
-    if (strcmp(argv[1], "-d") != 0) { 
-        printf("Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-        exit(2);
+    for (int i = 1; i < argc; i++) {
+        if (IsInputFile(argv[i])) {
+            inputFiles.Append(argv[i]);
+            debugKeysFollow = false;
+        } else if (!strncmp(argv[i], "-O", 2)
+                   && strspn(argv[i] + 2, "0123456789") == strlen(argv[i] + 2)) {
+            if (argv[i][2] && (argv[i][3] || argv[i][2] > '2')) Usage();
+            SetOption("O", argv[i][2] ? argv[i] + 2 : "1");
+            debugKeysFollow = false;
+        } else if (!strcmp(argv[i], "-d")) {
+            debugKeysFollow = true;
+        } else if (!strncmp(argv[i], "--", 2) && argv[i][2]) {
+            char *key = strdup(argv[i] + 2);
+            char *value = strchr(key, '=');
+            if (value) *value++ = '\0';
+            if (!IsKnownOption(key)) Usage();
+            if (!strcmp(key, "lexer") && (!value || (strcmp(value, "flex")
+                                                     && strcmp(value, "fast"))))
+                Usage();
+            SetOption(key, value);
+            debugKeysFollow = false;
+        } else if (debugKeysFollow) {
+            SetDebugForKey(argv[i], true);
+        } else {
+            Usage();
+        }
     }
-
-    for (int i = 2; i < argc; i++)
-        SetDebugForKey(argv[i], true);
 }
 
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+template<class Element> class List;
+
 
 void Failure(const char *format, ...);
 
@@ -24,7 +26,20 @@ void SetDebugForKey(const char *key, bool val);
 bool IsDebugOn(const char *key);
 
 
+void InheritDebugKeys(List<const char*> *keys);
+
+
+
+
+void SetOption(const char *key, const char *value);
+const char *GetOption(const char *key);
+List<const char*> *GetOptionKeys();
+
+
 void ParseCommandLine(int argc, char *argv[]);
 
+
+List<const char*> *GetInputFiles();
+
 #endif
 